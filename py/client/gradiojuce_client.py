@@ -1,19 +1,37 @@
 import argparse
+import concurrent.futures
+import gradio_client
 from gradio_client import Client
 from pathlib import Path
+import hashlib
 import json
+import os
+import random
+import shutil
 import signal
+import sys
+import tempfile
 import time
 
+import httpx
+
 
 class TimeoutError(Exception):
     pass
 
+class CanceledError(Exception):
+    pass
+
 client = None
+# every (client, job) pair that is currently running, so they can all be canceled
+active_jobs = []
 def handler_stop_signals(signum, frame):
     global client
     print("Stopping client...")
-    if client is not None:
+    if active_jobs:
+        for c, job in list(active_jobs):
+            cancel_job(c, job)
+    elif client is not None:
         # send a cancel request to the server
         client.submit(api_name="/wav2wav-cancel")
         print(f"Sent cancel request to {client.url}. Exiting...")
@@ -23,20 +41,476 @@ def handler_stop_signals(signum, frame):
 signal.signal(signal.SIGINT, handler_stop_signals)
 signal.signal(signal.SIGTERM, handler_stop_signals)
 
+
+# errors that are worth retrying: the space is waking up, overloaded or the network hiccuped
+TRANSIENT_STATUS_CODES = {408, 425, 429, 500, 502, 503, 504}
+TRANSIENT_MESSAGES = ("429", "502", "503", "504", "Too Many Requests", "Service Unavailable",
+                      "Bad Gateway", "Gateway Timeout", "timed out", "Connection reset")
+
+def is_transient(e: Exception) -> bool:
+    if isinstance(e, (httpx.TimeoutException, httpx.NetworkError, httpx.RemoteProtocolError, ConnectionError)):
+        return True
+    if isinstance(e, httpx.HTTPStatusError):
+        return e.response.status_code in TRANSIENT_STATUS_CODES
+    try:
+        import requests
+        if isinstance(e, (requests.exceptions.ConnectionError, requests.exceptions.Timeout)):
+            return True
+        if isinstance(e, requests.exceptions.HTTPError) and e.response is not None:
+            return e.response.status_code in TRANSIENT_STATUS_CODES
+    except ImportError:
+        pass
+    return any(m in str(e) for m in TRANSIENT_MESSAGES)
+
+
+# HARP gives every stage of a job its own time limit, these lines tell it which one we're in
+_stage = None
+def enter_stage(stage):
+    global _stage
+    if stage != _stage:
+        _stage = stage
+        print(f"HARP.Stage {stage}")
+
+STAGE_OF_STATUS = {
+    "STARTING": "upload",
+    "SENDING_DATA": "upload",
+    "JOINING_QUEUE": "queue",
+    "IN_QUEUE": "queue",
+    "QUEUE_FULL": "queue",
+    "PROCESSING": "inference",
+    "ITERATING": "inference",
+    "PROGRESS": "inference",
+    "LOG": "inference",
+}
+
+def enter_stage_of(status):
+    stage = STAGE_OF_STATUS.get(getattr(status.code, "name", str(status.code)))
+    if stage is not None:
+        enter_stage(stage)
+
+
+_last_progress = None
+def report_progress(status):
+    """
+    Prints a HARP.Progress line with the queue position, ETA and percent done
+    from a job status, whenever they change. HARP shows them in its status bar.
+    """
+    global _last_progress
+    progress = {
+        "queue_position": getattr(status, "rank", None),
+        "queue_size": getattr(status, "queue_size", None),
+        "eta": getattr(status, "eta", None),
+        "percent": None,
+    }
+    units = getattr(status, "progress_data", None)
+    if units:
+        unit = units[-1]
+        if getattr(unit, "progress", None) is not None:
+            progress["percent"] = 100 * unit.progress
+        elif getattr(unit, "index", None) is not None and getattr(unit, "length", None):
+            progress["percent"] = 100 * unit.index / unit.length
+    if progress["eta"] is not None:
+        progress["eta"] = round(progress["eta"], 1)
+    if progress["percent"] is not None:
+        progress["percent"] = round(progress["percent"], 1)
+
+    progress = {k: v for k, v in progress.items() if v is not None}
+    if progress != _last_progress:
+        _last_progress = progress
+        print(f"HARP.Progress {json.dumps(progress)}")
+
+
+def with_retries(fn, max_retries: int = 3, base_delay: float = 1.0, max_delay: float = 30.0, should_stop=None):
+    """
+    Calls fn until it succeeds, retrying transient errors with exponential
+    backoff and full jitter. Anything else is raised right away.
+    If should_stop returns True while waiting for a retry, a CanceledError is raised.
+    """
+    attempt = 0
+    while True:
+        try:
+            return fn()
+        except Exception as e:
+            if attempt >= max_retries or not is_transient(e):
+                raise
+            delay = random.uniform(0, min(max_delay, base_delay * 2 ** attempt))
+            attempt += 1
+            print(f"HARP.Retry {attempt}/{max_retries} in {delay:.1f}s after {type(e).__name__}: {e}")
+            retry_at = time.time() + delay
+            while time.time() < retry_at:
+                if should_stop is not None and should_stop():
+                    raise CanceledError()
+                time.sleep(min(0.05, max(0, retry_at - time.time())))
+
+
+# a space's config and API info, per url. the helper runs once per job, so
+# they are also kept on disk and every run after the first skips fetching them.
+CONFIG_CACHE_DIR = Path(tempfile.gettempdir()) / "harp_gradio_config"
+CONFIG_CACHE_FORMAT = 1
+_config_cache = {}
+
+def _config_cache_file(url):
+    return CONFIG_CACHE_DIR / (hashlib.sha256(url.encode()).hexdigest()[:16] + ".json")
+
+def _config_cache_entry(url):
+    if url in _config_cache:
+        return _config_cache[url]
+    try:
+        entry = json.loads(_config_cache_file(url).read_text())
+    except (OSError, ValueError):
+        return None
+    # a config fetched by another client version may not mean the same thing to this one
+    if (entry.get("format") != CONFIG_CACHE_FORMAT or entry.get("url") != url
+            or entry.get("client_version") != getattr(gradio_client, "__version__", None)):
+        return None
+    _config_cache[url] = entry
+    return entry
+
+def _store_config(url, key, value):
+    entry = _config_cache.get(url) or {
+        "format": CONFIG_CACHE_FORMAT,
+        "url": url,
+        "client_version": getattr(gradio_client, "__version__", None),
+    }
+    entry[key] = value
+    _config_cache[url] = entry
+    try:
+        CONFIG_CACHE_DIR.mkdir(parents=True, exist_ok=True)
+        fd, tmp_path = tempfile.mkstemp(dir=CONFIG_CACHE_DIR, suffix=".part")
+        with os.fdopen(fd, "w") as f:
+            json.dump(entry, f)
+        os.replace(tmp_path, _config_cache_file(url))
+    except (OSError, TypeError, ValueError) as e:
+        # not being able to cache is not a reason to fail the job
+        print(f"HARP.ConfigCache failed to save the config for {url}: {e}")
+
+def invalidate_config(url):
+    _config_cache.pop(url, None)
+    _config_cache_file(url).unlink(missing_ok=True)
+
+
+class CachedConfigClient(Client):
+    """
+    A Client that takes the space config and API info from the config cache
+    when it can, so it can go straight to uploading and submitting.
+    """
+    config_from_cache = False
+
+    def _cached(self, key, fetch):
+        entry = _config_cache_entry(self.src)
+        if entry is not None and key in entry:
+            self.config_from_cache = True
+            return entry[key]
+        value = fetch()
+        _store_config(self.src, key, value)
+        return value
+
+    def _get_config(self):
+        return self._cached("config", super()._get_config)
+
+    def _get_api_info(self):
+        return self._cached("api_info", super()._get_api_info)
+
+
+# files already on a space, per url and content hash, so the same audio is only
+# uploaded once (sweeps, live previews and repeated runs all send the same input).
+# spaces drop their uploads when they restart, so entries are only trusted for a while,
+# and a job that fails with one is tried again with a fresh upload.
+UPLOAD_CACHE_DIR = Path(tempfile.gettempdir()) / "harp_uploads"
+# whether this run sent a file that was uploaded by an earlier one
+_reused_upload = False
+
+def _upload_cache_file(url):
+    return UPLOAD_CACHE_DIR / (hashlib.sha256(url.encode()).hexdigest()[:16] + ".json")
+
+def _load_uploads(url):
+    try:
+        uploads = json.loads(_upload_cache_file(url).read_text())
+    except (OSError, ValueError):
+        return {}
+    return uploads if isinstance(uploads, dict) else {}
+
+def _save_uploads(url, uploads):
+    try:
+        UPLOAD_CACHE_DIR.mkdir(parents=True, exist_ok=True)
+        fd, tmp_path = tempfile.mkstemp(dir=UPLOAD_CACHE_DIR, suffix=".part")
+        with os.fdopen(fd, "w") as f:
+            json.dump(uploads, f)
+        os.replace(tmp_path, _upload_cache_file(url))
+    except (OSError, TypeError, ValueError) as e:
+        print(f"HARP.UploadCache failed to save the uploads for {url}: {e}")
+
+def forget_uploads(url):
+    _upload_cache_file(url).unlink(missing_ok=True)
+
+def file_hash(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for block in iter(lambda: f.read(1 << 20), b""):
+            h.update(block)
+    return h.hexdigest()
+
+def can_reuse_uploads():
+    # only gradio_client 1.x and later send a file dict that isn't tagged as FileData
+    # as it is, so older ones can't be handed a file that is already on the server
+    version = getattr(gradio_client, "__version__", "0")
+    try:
+        return int(version.split(".")[0]) >= 1
+    except ValueError:
+        return False
+
+def _server_root(c):
+    # where the space serves its api, from its config (newer servers put it under a prefix)
+    root = (c.config.get("root") or c.src).rstrip("/")
+    return root + c.config.get("api_prefix", "")
+
+def upload_once(c, path, ttl):
+    """
+    Returns a file dict for path that points at a copy already on the space,
+    uploading it only if the space doesn't have this content yet (or the
+    copy it has is older than ttl seconds). Like handle_file, the dict has the
+    server path in "path" and the url in "url", so the space reads its own copy
+    (which also works for private spaces, where the url needs a token).
+    """
+    digest = file_hash(path)
+    uploads = _load_uploads(c.src)
+    now = time.time()
+    # entries without a server path were written by older versions and are uploaded again
+    uploads = {k: v for k, v in uploads.items() if "path" in v and now - v.get("uploaded", 0) < ttl}
+
+    global _reused_upload
+    entry = uploads.get(digest)
+    if entry is not None:
+        _reused_upload = True
+        print(f"HARP.UploadCache reusing {entry['path']}")
+    else:
+        enter_stage("upload")
+        root = _server_root(c)
+        headers = {"Authorization": f"Bearer {c.hf_token}"} if getattr(c, "hf_token", None) else {}
+        with open(path, "rb") as f:
+            r = httpx.post(root + "/upload", headers=headers, files=[("files", (Path(path).name, f))], timeout=60)
+        r.raise_for_status()
+        server_path = r.json()[0]
+        entry = {"path": server_path, "url": root + "/file=" + server_path, "uploaded": now}
+        uploads[digest] = entry
+        print(f"HARP.UploadCache uploaded {path} as {entry['path']}")
+    _save_uploads(c.src, uploads)
+    # the client uploads every dict tagged as FileData whose path isn't an url, so the
+    # tag is left off and the server takes the dict as a file it already has
+    return {"path": entry["path"], "url": entry["url"], "orig_name": Path(path).name}
+
+def with_uploaded_files(c, ctrls, ttl):
+    """The controls with every local file replaced by its copy on the space."""
+    return [upload_once(c, v, ttl) if isinstance(v, str) and os.path.isfile(v) else v for v in ctrls]
+
+
+def make_client(url):
+    # results are streamed straight to their destination by save_result,
+    # so the client should not download them into its own cache first
+    try:
+        return CachedConfigClient(url, download_files=False)
+    except TypeError:
+        # older gradio_client versions always download
+        return CachedConfigClient(url)
+
+
+def save_result(c, result, output_path):
+    """
+    Writes a result file to output_path. Remote files are streamed into a
+    temporary file next to output_path and renamed into place, so the bytes
+    are written exactly once and output_path never holds a partial file.
+    """
+    output_path = Path(output_path)
+    if isinstance(result, dict):
+        url = result.get("url")
+        local_path = result.get("path")
+    else:
+        url = None
+        local_path = result
+
+    if url:
+        # named after output_path, so HARP can clean it up if it has to kill us mid-download
+        fd, tmp_path = tempfile.mkstemp(dir=output_path.parent, prefix=output_path.name + ".", suffix=".part")
+        try:
+            with os.fdopen(fd, "wb") as f, httpx.stream("GET", url, headers=c.headers, follow_redirects=True, timeout=60) as r:
+                r.raise_for_status()
+                for block in r.iter_bytes(1 << 20):
+                    f.write(block)
+            os.replace(tmp_path, output_path)
+        except BaseException:
+            Path(tmp_path).unlink(missing_ok=True)
+            raise
+    elif local_path and Path(local_path).exists():
+        # already downloaded by the client: a rename if it's on the same
+        # filesystem, otherwise a single copy into place
+        shutil.move(local_path, output_path)
+    else:
+        raise ValueError(f"Got a result without a file: {result}")
+
+
+def cancel_job(c, job):
+    try:
+        job.cancel()
+        c.submit(api_name="/wav2wav-cancel")
+        print(f"Sent cancel request to {c.src}.")
+    except Exception as e:
+        print(f"Failed to cancel job on {c.src}: {e}")
+
+
+def predict(url, ctrls, cancel_flag_path, status_flag_path, hedge_after, hedge_url, retry, upload_ttl=0):
+    """
+    Submits the prediction and waits for it. If hedge_after > 0 and the job
+    is still running after that many seconds, a duplicate is submitted to
+    hedge_url (or a new session on the same url), and whichever one finishes
+    first wins. The other one is canceled.
+    With upload_ttl > 0, the input files go through the upload cache.
+    """
+    global client
+    active_jobs.clear()
+    submitted = with_uploaded_files(client, ctrls, upload_ttl) if upload_ttl > 0 else ctrls
+    active_jobs.append((client, client.submit(*submitted, api_name="/wav2wav")))
+    t0 = time.time()
+    last_code = None
+
+    # the hedge connects (and uploads, for another space) in the background, so this
+    # loop keeps watching the cancel flag and the first job while it does
+    hedged = False
+    hedge_stopped = False
+    hedge_setup = None
+    executor = concurrent.futures.ThreadPoolExecutor(max_workers=1)
+
+    def cancelled():
+        return hedge_stopped or (cancel_flag_path is not None and Path(cancel_flag_path).exists())
+
+    def make_hedge(target):
+        hedge_client = with_retries(lambda: make_client(target), **retry, should_stop=cancelled)
+        if target == url:
+            # a new session on the same space can use the files the first job sent
+            return hedge_client, submitted
+        # another space needs its own copy of the files
+        hedge_ctrls = with_uploaded_files(hedge_client, ctrls, upload_ttl) if upload_ttl > 0 else ctrls
+        return hedge_client, hedge_ctrls
+
+    try:
+        while True:
+            # check if the cancel flag exists
+            # if it does, cancel the job
+            if cancel_flag_path is not None:
+                if Path(cancel_flag_path).exists():
+                    print("Cancel flag detected. Cancelling...")
+                    for c, job in list(active_jobs):
+                        cancel_job(c, job)
+                    active_jobs.clear()
+                    if status_flag_path is not None:
+                        Path(status_flag_path).write_text("Status.CANCELED")
+                    raise CanceledError()
+
+            if hedge_after > 0 and not hedged and time.time() - t0 > hedge_after:
+                hedged = True
+                target = hedge_url or url
+                print(f"HARP.Hedge job still running after {hedge_after}s, sending a duplicate to {target}")
+                hedge_setup = executor.submit(make_hedge, target)
+
+            if hedge_setup is not None and hedge_setup.done():
+                try:
+                    hedge_client, hedge_ctrls = hedge_setup.result()
+                    active_jobs.append((hedge_client, hedge_client.submit(*hedge_ctrls, api_name="/wav2wav")))
+                except Exception as e:
+                    # the first job is still running, it just has no company
+                    print(f"HARP.Hedge failed to send the duplicate ({e}), waiting for the first job")
+                hedge_setup = None
+
+            for c, job in list(active_jobs):
+                if not job.done():
+                    continue
+                try:
+                    result = job.result()
+                except Exception as e:
+                    # a failed hedge is fine as long as the other one is still running
+                    if len(active_jobs) > 1:
+                        print(f"Job on {c.src} failed ({e}), waiting for the other one")
+                        active_jobs.remove((c, job))
+                        continue
+                    raise
+                for other_c, other_job in active_jobs:
+                    if other_job is not job:
+                        print(f"HARP.Hedge {c.src} finished first, canceling the other job")
+                        cancel_job(other_c, other_job)
+                active_jobs.clear()
+                # the file has to come from the client that produced it
+                return c, result
+
+            # check if we were given a status path
+            # if it does, write the status to the file
+            status = active_jobs[0][1].status()
+            enter_stage_of(status)
+            report_progress(status)
+
+            # only when it changes, this loop runs 20 times a second
+            if status.code != last_code:
+                last_code = status.code
+                print(f"Status: {status}")
+                if status_flag_path is not None:
+                    Path(status_flag_path).write_text(str(status.code))
+
+            time.sleep(0.05)
+    finally:
+        # nothing waits for a hedge that is still connecting, it gives up at its next retry
+        hedge_stopped = True
+        executor.shutdown(wait=False)
+
+
+
 def main(
-        url: str, 
-        output_path: str, 
-        mode: str, 
-        ctrls_path : str = None, 
+        url: str,
+        output_path: str,
+        mode: str,
+        ctrls_path : str = None,
         ctrls_timeout: float = 30,
         cancel_flag_path: str = None,
-        status_flag_path: str = None
+        status_flag_path: str = None,
+        max_retries: int = 3,
+        retry_base_delay: float = 1.0,
+        retry_max_delay: float = 30.0,
+        hedge_after: float = 0,
+        hedge_url: str = None,
+        refresh_config: bool = False,
+        pid_path: str = None,
+        upload_ttl: float = 0,
+        input_path: str = None,
     ):
     assert url, "Please specify a url to connect to."
-    assert output_path, "Please specify an output path."
+    assert output_path or mode == "upload", "Please specify an output path."
+    if pid_path is not None:
+        # our own process group, so HARP can kill us and anything we started
+        # in one go if we don't stop after a cancel
+        if hasattr(os, "setpgrp"):
+            os.setpgrp()
+        Path(pid_path).write_text(str(os.getpid()))
     global client
-    client = Client(url)
-    
+    retry = dict(max_retries=max_retries, base_delay=retry_base_delay, max_delay=retry_max_delay)
+    if refresh_config:
+        invalidate_config(url)
+    enter_stage("connect")
+    client = with_retries(lambda: make_client(url), **retry)
+
+    def fresh_config_on_failure(fn):
+        # the space may have changed since its config was cached. if that's
+        # why fn failed, it works the second time around with a fresh one.
+        global client
+        try:
+            return fn()
+        except (CanceledError, TimeoutError):
+            raise
+        except Exception as e:
+            if not client.config_from_cache:
+                raise
+            print(f"HARP.ConfigCache failed with a cached config ({e}), fetching it again")
+            invalidate_config(url)
+            enter_stage("connect")
+            client = with_retries(lambda: make_client(url), **retry)
+            return fn()
+
     if mode == "get_ctrls":
         print(f"Getting controls for {url}...")
         # ctrls will be a dict, instead of a path now
@@ -44,27 +518,39 @@ def main(
         print(f"calling predict ")
         # ctrls = client.predict(api_name="/wav2wav-ctrls")
 
-        job = client.submit(api_name="/wav2wav-ctrls")
-        canceled = False
-        t0 = time.time()
-        while not job.done():
+        def get_ctrls():
+            job = client.submit(api_name="/wav2wav-ctrls")
+            t0 = time.time()
+            while not job.done():
+                if cancel_flag_path is not None and Path(cancel_flag_path).exists():
+                    print("Cancel flag detected. Cancelling...")
+                    cancel_job(client, job)
+                    raise CanceledError()
+                enter_stage_of(job.status())
+
+                if time.time() - t0 > ctrls_timeout:
+                    print(f"Timeout of {ctrls_timeout} seconds reached. Cancelling...")
+                    print(f"HARP.TimedOut")
+                    client.submit(api_name="/wav2wav-cancel")
+                    if status_flag_path is not None:
+                        Path(status_flag_path).write_text("Status.CANCELED")
+                    # break
+                    raise TimeoutError(f"Timeout of {ctrls_timeout} seconds reached. Cancelling...")
 
-            if time.time() - t0 > ctrls_timeout:
-                print(f"Timeout of {ctrls_timeout} seconds reached. Cancelling...")
-                print(f"HARP.TimedOut")
-                client.submit(api_name="/wav2wav-cancel")
-                canceled = True
-                Path(status_flag_path).write_text("Status.CANCELED")
-                # break
-                raise TimeoutError("Timeout of {ctrls_timeout} seconds reached. Cancelling...")
+                time.sleep(0.05)
 
-            time.sleep(0.05)
+            return job.result()
 
-        ctrls = job.result()
+        try:
+            ctrls = fresh_config_on_failure(lambda: with_retries(get_ctrls, **retry))
+        except CanceledError:
+            print("Getting controls was canceled.")
+            return
         print(f"got ctrls: {ctrls}")
-        # if it's a string, it's a filepath
-        if isinstance(ctrls, str):
-            Path(ctrls).rename(output_path)
+        # if it's a string (or a file dict), it's a file
+        if isinstance(ctrls, str) or (isinstance(ctrls, dict) and "url" in ctrls and "path" in ctrls):
+            enter_stage("download")
+            save_result(client, ctrls, output_path)
         # if it's not, likely that it's the actual controls
         else:
             print(f"Saving ctrls to {output_path}...")
@@ -78,55 +564,82 @@ def main(
             assert isinstance(ctrls, list), "Controls must be a list of parameter values."
             print(f"loaded ctrls: {ctrls}")
         print(f"Predicting audio for {url}...")
-        job = client.submit(*ctrls, api_name="/wav2wav")
 
-        canceled = False
-        while not job.done():
-            # check if the cancel flag exists
-            # if it does, cancel the job
-            if cancel_flag_path is not None:
-                if Path(cancel_flag_path).exists():
-                    print("Cancel flag detected. Cancelling...")
-                    client.submit(api_name="/wav2wav-cancel")
-                    canceled = True
-                    Path(status_flag_path).write_text("Status.CANCELED")
-                    break
-            
-            # check if we were given a status path
-            # if it does, write the status to the file
-            status = job.status()
-            print(f"Status: {status}")
+        if upload_ttl > 0 and not can_reuse_uploads():
+            print("HARP.UploadCache this gradio_client can't reuse uploads, sending the files every time")
+            upload_ttl = 0
 
-            if status_flag_path is not None:
-                Path(status_flag_path).write_text(str(status.code))
-        
-            time.sleep(0.05)
-        
-        if not canceled:
-            audio_path = job.result()
+        def run(ttl):
+            return fresh_config_on_failure(lambda: with_retries(
+                lambda: predict(url, ctrls, cancel_flag_path, status_flag_path, hedge_after, hedge_url, retry, ttl),
+                **retry,
+                should_stop=lambda: cancel_flag_path is not None and Path(cancel_flag_path).exists()
+            ))
 
-            print(f"Saving audio to {output_path}...")
-            Path(audio_path).rename(output_path)
-        else:
-            # still consume the result and block? 
+        try:
+            try:
+                result_client, audio = run(upload_ttl)
+            except (CanceledError, TimeoutError):
+                raise
+            except Exception as e:
+                if not _reused_upload:
+                    raise
+                # the space may have dropped the file since it was uploaded
+                print(f"HARP.UploadCache failed with a reused upload ({e}), uploading again")
+                forget_uploads(client.src)
+                result_client, audio = run(upload_ttl)
+        except CanceledError:
+            # still consume the result and block?
             # job.result()
-            pass
+            audio = None
+
+        if audio is not None:
+            print(f"Saving audio to {output_path}...")
+            enter_stage("download")
+            with_retries(lambda: save_result(result_client, audio, output_path), **retry)
+
+    elif mode == "upload":
+        # sends input_path ahead of a prediction, which then finds it in the upload cache
+        assert input_path is not None, "Please specify an input path."
+        if upload_ttl <= 0 or not can_reuse_uploads():
+            print("HARP.UploadCache uploads can't be reused, there is nothing to do ahead of time")
+            return
+        fresh_config_on_failure(lambda: with_retries(lambda: upload_once(client, input_path, upload_ttl), **retry))
 
     else:
-        raise ValueError("Invalid mode. Choose either 'get_ctrls' or 'predict'.")
+        raise ValueError("Invalid mode. Choose 'get_ctrls', 'predict' or 'upload'.")
 
     print("gradiojuce_client done! :)")
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description='Process some arguments.')
     parser.add_argument('--url', required=True, help='The URL to connect to.')
-    parser.add_argument('--output_path', required=True, help='The output path to save the file.')
-    parser.add_argument('--mode', required=True, choices=['get_ctrls', 'predict'], help='The mode of operation.')
+    parser.add_argument('--output_path', help='The output path to save the file.')
+    parser.add_argument('--mode', required=True, choices=['get_ctrls', 'predict', 'upload'], help='The mode of operation.')
+    parser.add_argument('--input_path', help='The file to upload (upload mode only).')
     parser.add_argument('--ctrls_path', help='The path to the controls file.')
     parser.add_argument('--cancel_flag_path', help='The path to the cancel flag file.')
     parser.add_argument('--status_flag_path', help='The path to the status flag file.')
     parser.add_argument('--ctrls_timeout', type=float, default=30, help='The timeout for getting controls.')
-    
+    parser.add_argument('--max_retries', type=int, default=3, help='How often to retry transient network errors.')
+    parser.add_argument('--retry_base_delay', type=float, default=1.0, help='The first retry waits up to this many seconds, doubling every time.')
+    parser.add_argument('--retry_max_delay', type=float, default=30.0, help='The longest a retry will wait.')
+    parser.add_argument('--hedge_after', type=float, default=0, help='Send a duplicate request if the job is still running after this many seconds (0 = off).')
+    parser.add_argument('--hedge_url', help='Where to send the duplicate request (default: the same url).')
+    parser.add_argument('--pid_path', help='Where to write our pid, which HARP uses to kill us if a cancel takes too long.')
+    parser.add_argument('--refresh_config', action='store_true', help="Fetch the space's config again instead of using the cached one.")
+    parser.add_argument('--upload_ttl', type=float, default=0, help='Reuse a file already uploaded to the space for this many seconds (0 = always upload).')
+
     args = parser.parse_args()
-    
-    main(**vars(args))
+
+    # HARP reads our output as it comes, so it has to come out line by line
+    if hasattr(sys.stdout, "reconfigure"):
+        sys.stdout.reconfigure(line_buffering=True)
+
+    try:
+        main(**vars(args))
+    except Exception as e:
+        # HARP only backs off from a space when the space (or the way to it) is what failed
+        if is_transient(e):
+            print(f"HARP.Transient {type(e).__name__}")
+        raise
@@ -0,0 +1,182 @@
+/**
+ * @file
+ * @brief How many jobs may run against one space at the same time. The limit
+ * adapts to what the space can take (AIMD): it grows while jobs get through the
+ * space's queue quickly, and is cut back when they start to wait in it, fail on the
+ * space's side or hit a rate limit. On top of that, a token bucket caps how often jobs may start.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "juce_core/juce_core.h"
+
+#include "Settings.h"
+
+class AdaptiveLimiter {
+  using Clock = std::chrono::steady_clock;
+
+public:
+  enum class Outcome { Success, RateLimited, Failed, Cancelled };
+
+  // the limiter shared by every job that goes to url
+  static AdaptiveLimiter& forUrl(const std::string& url) {
+    static std::mutex mutex;
+    static std::map<std::string, std::unique_ptr<AdaptiveLimiter>> limiters;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& limiter = limiters[url];
+    if (limiter == nullptr) {
+      limiter.reset(new AdaptiveLimiter());
+    }
+    return *limiter;
+  }
+
+  /**
+   * @brief A job's place in the limit, from acquire() until finish() (or until it's destroyed,
+   * which counts as cancelled and leaves the limit as it was).
+   */
+  class Slot {
+  public:
+    Slot(AdaptiveLimiter& limiter) : m_limiter(&limiter), m_start(Clock::now()) {}
+    Slot(Slot&& other) noexcept : m_limiter(other.m_limiter), m_start(other.m_start) { other.m_limiter = nullptr; }
+    Slot(const Slot&) = delete;
+    Slot& operator=(const Slot&) = delete;
+
+    ~Slot() {
+      finish(Outcome::Cancelled);
+    }
+
+    // queueSeconds is how long the job waited in the space's own queue
+    void finish(Outcome outcome, double queueSeconds = 0) {
+      if (m_limiter != nullptr) {
+        m_limiter->release(outcome, std::chrono::duration<double>(Clock::now() - m_start).count(), queueSeconds);
+        m_limiter = nullptr;
+      }
+    }
+
+  private:
+    AdaptiveLimiter* m_limiter;
+    Clock::time_point m_start;
+  };
+
+  /**
+   * @brief Waits until a job may start: there is room under the limit and a token in the bucket.
+   * @return nothing if cancelFlag showed up while waiting.
+   */
+  std::unique_ptr<Slot> acquire(const juce::File& cancelFlag) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      // a stat can be slow, so the other jobs shouldn't wait for it
+      lock.unlock();
+      const bool cancelled = cancelFlag != juce::File() && cancelFlag.exists();
+      lock.lock();
+      if (cancelled) {
+        return nullptr;
+      }
+
+      const auto now = Clock::now();
+      refill(now);
+      const bool underLimit = m_inFlight < juce::jmax(1, (int) m_limit);
+      if (underLimit && now >= m_pausedUntil && (m_tokens >= 1.0 || ratePerSecond() <= 0)) {
+        if (ratePerSecond() > 0) {
+          m_tokens -= 1.0;
+        }
+        ++m_inFlight;
+        return std::make_unique<Slot>(*this);
+      }
+      // the cancel flag is a file, so it has to be looked at every now and then
+      m_changed.wait_for(lock, std::chrono::milliseconds(100));
+    }
+  }
+
+  // the current limit, for the log
+  double getLimit() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limit;
+  }
+
+private:
+  // a job that waited longer than this in the space's queue means the space is saturated
+  static constexpr double queueTolerance = 1.0;
+  // how long nothing new starts after the space says it's getting too many requests
+  static constexpr double rateLimitPauseSeconds = 5.0;
+
+  AdaptiveLimiter() = default;
+
+  void release(Outcome outcome, double seconds, double queueSeconds) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_inFlight;
+      const double maxLimit = juce::jmax(1, HARPSettings::getInt(settingkeys::maxJobsPerSpace));
+      const auto now = Clock::now();
+
+      switch (outcome) {
+        case Outcome::Success:
+          m_fastest = m_fastest <= 0 ? seconds : juce::jmin(m_fastest, seconds);
+          if (queueSeconds > queueTolerance) {
+            decrease(now, 0.75);
+          } else {
+            // slow start doubles the limit every round trip, until the first cut
+            m_limit = juce::jmin(maxLimit, m_limit + (m_slowStart ? 1.0 : 1.0 / m_limit));
+          }
+          break;
+        case Outcome::RateLimited:
+          decrease(now, 0.5);
+          m_pausedUntil = now + toDuration(rateLimitPauseSeconds);
+          m_tokens = 0;
+          break;
+        case Outcome::Failed:
+          decrease(now, 0.5);
+          break;
+        case Outcome::Cancelled:
+          break;
+      }
+      m_limit = juce::jlimit(1.0, maxLimit, m_limit);
+    }
+    m_changed.notify_all();
+  }
+
+  // cuts the limit at most once per round trip, since the jobs that were
+  // already running when things went wrong all report the same problem
+  void decrease(Clock::time_point now, double factor) {
+    m_slowStart = false;
+    if (now < m_nextDecrease) {
+      return;
+    }
+    m_limit *= factor;
+    m_nextDecrease = now + toDuration(juce::jmax(1.0, m_fastest));
+  }
+
+  double ratePerSecond() const {
+    return HARPSettings::getDouble(settingkeys::maxJobsPerMinute) / 60.0;
+  }
+
+  void refill(Clock::time_point now) {
+    const auto rate = ratePerSecond();
+    const double seconds = std::chrono::duration<double>(now - m_lastRefill).count();
+    m_lastRefill = now;
+    // a burst can use up to one limit's worth of tokens at once
+    m_tokens = juce::jmin(juce::jmax(1.0, m_limit), m_tokens + seconds * rate);
+  }
+
+  static Clock::duration toDuration(double seconds) {
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+  }
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_changed;
+  int m_inFlight = 0;
+  double m_limit = 2.0;
+  bool m_slowStart = true;
+  // the quickest a job has come back, which is what an idle space takes
+  double m_fastest = 0;
+  double m_tokens = 1.0;
+  Clock::time_point m_lastRefill {Clock::now()};
+  Clock::time_point m_pausedUntil {};
+  Clock::time_point m_nextDecrease {};
+};
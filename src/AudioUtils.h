@@ -0,0 +1,230 @@
+/**
+ * @file
+ * @brief Helpers for moving audio between files and buffers, used wherever
+ * HARP has to cut up, convert or stitch together audio around a model call.
+ */
+
+#pragma once
+
+#include "juce_audio_basics/juce_audio_basics.h"
+#include "juce_audio_formats/juce_audio_formats.h"
+
+namespace audioutils {
+
+  // reads a whole audio file into buffer
+  inline bool readFile(const juce::File& file, juce::AudioBuffer<float>& buffer, double& sampleRate) {
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+    if (reader == nullptr) {
+      DBG("audioutils::readFile: failed to create a reader for " << file.getFullPathName());
+      return false;
+    }
+
+    buffer.setSize((int) reader->numChannels, (int) reader->lengthInSamples);
+    reader->read(&buffer, 0, (int) reader->lengthInSamples, 0, true, true);
+    sampleRate = reader->sampleRate;
+    return true;
+  }
+
+  // reads lengthSeconds of audio starting at startSeconds, without decoding the rest of the file.
+  // the range is clamped to the file, so the buffer can come back shorter than asked for.
+  inline bool readRange(const juce::File& file, juce::AudioBuffer<float>& buffer, double& sampleRate,
+                        double startSeconds, double lengthSeconds) {
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+    if (reader == nullptr) {
+      DBG("audioutils::readRange: failed to create a reader for " << file.getFullPathName());
+      return false;
+    }
+
+    auto start = juce::jlimit((juce::int64) 0, reader->lengthInSamples, (juce::int64) (startSeconds * reader->sampleRate));
+    auto length = juce::jmin(reader->lengthInSamples - start, (juce::int64) (lengthSeconds * reader->sampleRate));
+
+    buffer.setSize((int) reader->numChannels, (int) length);
+    reader->read(&buffer, 0, (int) length, start, true, true);
+    sampleRate = reader->sampleRate;
+    return true;
+  }
+
+  // the number of channels in file, or 0 if it can't be read
+  inline int numChannels(const juce::File& file) {
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+    return reader == nullptr ? 0 : (int) reader->numChannels;
+  }
+
+  // the average of all channels of buffer, as a mono buffer
+  inline juce::AudioBuffer<float> downmix(const juce::AudioBuffer<float>& buffer) {
+    juce::AudioBuffer<float> mono(1, buffer.getNumSamples());
+    if (buffer.getNumChannels() == 0) {
+      mono.clear();
+      return mono;
+    }
+    const float gain = 1.0f / (float) buffer.getNumChannels();
+    auto* out = mono.getWritePointer(0);
+    juce::FloatVectorOperations::copyWithMultiply(out, buffer.getReadPointer(0), gain, buffer.getNumSamples());
+    for (int ch = 1; ch < buffer.getNumChannels(); ++ch) {
+      juce::FloatVectorOperations::addWithMultiply(out, buffer.getReadPointer(ch), gain, buffer.getNumSamples());
+    }
+    return mono;
+  }
+
+  // writes buffer to file as a (32 bit float) wav, replacing anything that was there
+  inline bool writeWav(const juce::File& file, const juce::AudioBuffer<float>& buffer, double sampleRate) {
+    file.deleteFile();
+
+    std::unique_ptr<juce::OutputStream> stream = file.createOutputStream();
+    if (stream == nullptr) {
+      DBG("audioutils::writeWav: failed to open " << file.getFullPathName());
+      return false;
+    }
+
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(
+        stream.get(), sampleRate, (unsigned int) buffer.getNumChannels(), 32, {}, 0));
+    if (writer == nullptr) {
+      DBG("audioutils::writeWav: failed to create a writer for " << file.getFullPathName());
+      return false;
+    }
+    stream.release(); // the writer owns the stream now
+
+    return writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+  }
+
+  // converts buffer to the given sample rate and number of channels.
+  // models are free to return audio in whatever format they like, so
+  // this is needed before their output can be stitched back together.
+  inline void conform(juce::AudioBuffer<float>& buffer, double sampleRate,
+                      double targetSampleRate, int targetNumChannels) {
+    if (sampleRate != targetSampleRate && sampleRate > 0 && buffer.getNumSamples() > 0) {
+      const double ratio = sampleRate / targetSampleRate;
+      const int numOut = (int) std::round(buffer.getNumSamples() / ratio);
+      juce::AudioBuffer<float> resampled(buffer.getNumChannels(), numOut);
+
+      for (int ch = 0; ch < buffer.getNumChannels(); ++ch) {
+        juce::LagrangeInterpolator interpolator;
+        interpolator.process(ratio, buffer.getReadPointer(ch), resampled.getWritePointer(ch),
+                             numOut, buffer.getNumSamples(), 0);
+      }
+      buffer = std::move(resampled);
+    }
+
+    if (buffer.getNumChannels() != targetNumChannels && buffer.getNumChannels() > 0) {
+      juce::AudioBuffer<float> mapped(targetNumChannels, buffer.getNumSamples());
+      // extra channels are copies of the existing ones, missing channels are dropped
+      for (int ch = 0; ch < targetNumChannels; ++ch) {
+        mapped.copyFrom(ch, 0, buffer, ch % buffer.getNumChannels(), 0, buffer.getNumSamples());
+      }
+      buffer = std::move(mapped);
+    }
+  }
+
+  // splits [0, totalLength) into chunks of chunkLength samples, where
+  // each chunk also reaches overlap samples into the next one.
+  inline std::vector<juce::Range<juce::int64>> makeChunks(juce::int64 totalLength,
+                                                          juce::int64 chunkLength,
+                                                          juce::int64 overlap) {
+    std::vector<juce::Range<juce::int64>> chunks;
+    if (chunkLength <= 0 || totalLength <= chunkLength) {
+      chunks.push_back({0, totalLength});
+      return chunks;
+    }
+
+    for (juce::int64 start = 0; start < totalLength; start += chunkLength) {
+      chunks.push_back({start, std::min(totalLength, start + chunkLength + overlap)});
+    }
+    return chunks;
+  }
+
+  // joins buffers end to end, where consecutive buffers share overlap
+  // samples that are blended with an equal power crossfade.
+  // all buffers need to have the same number of channels.
+  inline juce::AudioBuffer<float> concatenate(const std::vector<juce::AudioBuffer<float>>& parts, int overlap) {
+    if (parts.empty()) {
+      return {};
+    }
+
+    int numChannels = parts.front().getNumChannels();
+    juce::int64 total = 0;
+    for (size_t i = 0; i < parts.size(); ++i) {
+      total += parts[i].getNumSamples();
+      if (i > 0) {
+        total -= std::min(overlap, std::min(parts[i].getNumSamples(), parts[i - 1].getNumSamples()));
+      }
+    }
+
+    juce::AudioBuffer<float> result(numChannels, (int) total);
+    result.clear();
+
+    int writePos = 0;
+    for (size_t i = 0; i < parts.size(); ++i) {
+      const auto& part = parts[i];
+      int fade = 0;
+      if (i > 0) {
+        fade = std::min(overlap, std::min(part.getNumSamples(), parts[i - 1].getNumSamples()));
+        writePos -= fade;
+      }
+
+      for (int ch = 0; ch < numChannels; ++ch) {
+        auto* out = result.getWritePointer(ch, writePos);
+        const auto* in = part.getReadPointer(ch % part.getNumChannels());
+
+        for (int n = 0; n < fade; ++n) {
+          // equal power: the outgoing tail is already in the result
+          const float t = (float) (n + 1) / (float) (fade + 1);
+          const float gainIn = std::sin(t * juce::MathConstants<float>::halfPi);
+          const float gainOut = std::cos(t * juce::MathConstants<float>::halfPi);
+          out[n] = out[n] * gainOut + in[n] * gainIn;
+        }
+        juce::FloatVectorOperations::copy(out + fade, in + fade, part.getNumSamples() - fade);
+      }
+      writePos += part.getNumSamples();
+    }
+    return result;
+  }
+
+  // replaces region of target with the matching samples of replacement, where
+  // replacement starts at replacementStart in target's timeline (so it may reach
+  // past the region on both sides). the edges are blended with an equal power
+  // crossfade of up to fade samples, taken from outside the region so that every
+  // sample inside it comes from the replacement. both buffers need the same layout.
+  inline void splice(juce::AudioBuffer<float>& target, const juce::AudioBuffer<float>& replacement,
+                     juce::int64 replacementStart, juce::Range<juce::int64> region, int fade) {
+    const juce::Range<juce::int64> available(replacementStart, replacementStart + replacement.getNumSamples());
+    region = region.getIntersectionWith(available).getIntersectionWith({0, (juce::int64) target.getNumSamples()});
+    if (region.isEmpty()) {
+      return;
+    }
+
+    const int fadeIn = (int) juce::jmin((juce::int64) fade, region.getStart() - available.getStart());
+    const int fadeOut = (int) juce::jmin((juce::int64) fade, available.getEnd() - region.getEnd(),
+                                         (juce::int64) target.getNumSamples() - region.getEnd());
+
+    for (int ch = 0; ch < target.getNumChannels(); ++ch) {
+      auto* out = target.getWritePointer(ch);
+      const auto* in = replacement.getReadPointer(ch % replacement.getNumChannels());
+
+      for (int n = 0; n < fadeIn; ++n) {
+        const auto i = region.getStart() - fadeIn + n;
+        const float t = (float) (n + 1) / (float) (fadeIn + 1);
+        out[i] = out[i] * std::cos(t * juce::MathConstants<float>::halfPi)
+                 + in[i - replacementStart] * std::sin(t * juce::MathConstants<float>::halfPi);
+      }
+
+      juce::FloatVectorOperations::copy(out + region.getStart(), in + (region.getStart() - replacementStart),
+                                        (int) region.getLength());
+
+      for (int n = 0; n < fadeOut; ++n) {
+        const auto i = region.getEnd() + n;
+        const float t = (float) (n + 1) / (float) (fadeOut + 1);
+        out[i] = in[i - replacementStart] * std::cos(t * juce::MathConstants<float>::halfPi)
+                 + out[i] * std::sin(t * juce::MathConstants<float>::halfPi);
+      }
+    }
+  }
+}
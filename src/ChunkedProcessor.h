@@ -0,0 +1,175 @@
+/**
+ * @file
+ * @brief Processing for inputs too large to send in one piece. The file is
+ * cut into chunks of audio that are uploaded and processed one at a time.
+ * Finished chunks are kept on disk, so a job that fails or gets cancelled picks
+ * up where it left off the next time. The model processes every chunk without
+ * the audio around it, so the result can differ from processing the whole file,
+ * which is why this is off unless chunkThresholdMB is set.
+ */
+
+#pragma once
+
+#include "juce_cryptography/juce_cryptography.h"
+
+#include "Wave2Wave.h"
+#include "AudioUtils.h"
+#include "Settings.h"
+
+namespace chunked {
+
+  // neighbouring chunks share this much audio, which is crossfaded when stitching
+  constexpr double overlapSeconds = 0.5;
+
+  inline bool shouldProcessInChunks(const juce::File& file) {
+    auto thresholdMB = HARPSettings::getInt(settingkeys::chunkThresholdMB);
+    return thresholdMB > 0 && file.getSize() > (juce::int64) thresholdMB * 1024 * 1024;
+  }
+
+  // where the finished chunks of a job live. the same file, model, controls and
+  // chunk length always map to the same directory, which is what makes resuming work.
+  inline juce::File stateDirectory(const Wave2Wave& model, const CtrlList& ctrls,
+                                   const juce::File& file, double chunkSeconds) {
+    auto key = file.getFullPathName() + "|" + juce::String(file.getSize())
+               + "|" + juce::String(file.getLastModificationTime().toMilliseconds())
+               + "|" + juce::String(model.space_url()) + "|" + model.ctrlsToJson(ctrls, "")
+               + "|" + juce::String(chunkSeconds);
+    return juce::File::getSpecialLocation(juce::File::tempDirectory)
+        .getChildFile("harp_chunks")
+        .getChildFile(juce::SHA256(key.toUTF8()).toHexString().substring(0, 16));
+  }
+
+  /**
+   * @brief Processes file in place, one chunk at a time.
+   * @param flags the flags of the whole job, every chunk is cancelled through them.
+   * @param onProgress called from the calling thread before every chunk.
+   * @return false if the job was cancelled, in which case file is left untouched.
+   * will throw a std::runtime_error if a chunk fails (the helper has already retried it
+   * by then). Either way the finished chunks stay on disk for the next attempt.
+   */
+  inline bool processInChunks(const Wave2Wave& model, const CtrlList& ctrls, const JobFlags& flags,
+                              const juce::File& file,
+                              std::function<void(const juce::String&)> onProgress = nullptr) {
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+    if (reader == nullptr) {
+      throw std::runtime_error("Failed to read " + file.getFullPathName().toStdString());
+    }
+
+    const auto chunkSeconds = HARPSettings::getDouble(settingkeys::chunkSeconds);
+    const auto sampleRate = reader->sampleRate;
+    const auto numChannels = (int) reader->numChannels;
+    const auto ranges = audioutils::makeChunks(reader->lengthInSamples,
+                                               (juce::int64) (chunkSeconds * sampleRate),
+                                               (juce::int64) (overlapSeconds * sampleRate));
+    const auto numChunks = (int) ranges.size();
+    if (onProgress) {
+      onProgress("The file is too large to send at once, processing it in " + juce::String(numChunks)
+                 + " chunks of " + juce::String(chunkSeconds, 0) + " s");
+    }
+
+    auto dir = stateDirectory(model, ctrls, file, chunkSeconds);
+    dir.createDirectory();
+    auto chunkFile = [&dir] (int k) { return dir.getChildFile(juce::String(k) + ".wav"); };
+
+    for (int k = 0; k < numChunks; ++k) {
+      auto done = chunkFile(k);
+      if (done.existsAsFile()) {
+        continue; // finished in an earlier attempt
+      }
+      if (flags.cancel.exists()) {
+        return false;
+      }
+
+      if (onProgress) {
+        onProgress("Processing chunk " + juce::String(k + 1) + "/" + juce::String(numChunks));
+      }
+
+      juce::AudioBuffer<float> chunk(numChannels, (int) ranges[(size_t) k].getLength());
+      reader->read(&chunk, 0, chunk.getNumSamples(), ranges[(size_t) k].getStart(), true, true);
+      // a chunk only gets its final name once it has been processed
+      auto work = done.withFileExtension("part.wav");
+      if (!audioutils::writeWav(work, chunk, sampleRate)) {
+        throw std::runtime_error("Failed to write chunk " + std::to_string(k + 1));
+      }
+
+      // the helper retries transient errors itself, a chunk that still fails stays failed
+      try {
+        if (!model.process(work, ctrls, flags)) {
+          work.deleteFile();
+          return false;
+        }
+      } catch (const std::runtime_error& e) {
+        work.deleteFile();
+        throw std::runtime_error(std::string(e.what()) + "\n Chunk " + std::to_string(k + 1) + "/"
+                                 + std::to_string(numChunks) + " failed. The " + std::to_string(k)
+                                 + " chunks before it are kept, press Process again to resume.");
+      }
+
+      if (!work.moveFileTo(done)) {
+        throw std::runtime_error("Failed to keep processed chunk " + std::to_string(k + 1));
+      }
+    }
+    reader.reset();
+
+    if (onProgress) {
+      onProgress("Joining " + juce::String(numChunks) + " chunks");
+    }
+
+    // stitch the chunks back together one at a time, holding back each chunk's
+    // overlap so it can be crossfaded with the start of the next one
+    juce::TemporaryFile temp(file);
+    {
+      juce::AudioBuffer<float> first;
+      double outSampleRate = 0;
+      if (!audioutils::readFile(chunkFile(0), first, outSampleRate)) {
+        throw std::runtime_error("Failed to read processed chunk 1");
+      }
+
+      std::unique_ptr<juce::OutputStream> stream = temp.getFile().createOutputStream();
+      juce::WavAudioFormat wavFormat;
+      std::unique_ptr<juce::AudioFormatWriter> writer(
+          stream == nullptr ? nullptr
+                            : wavFormat.createWriterFor(stream.get(), outSampleRate, (unsigned int) numChannels, 32, {}, 0));
+      if (writer == nullptr) {
+        throw std::runtime_error("Failed to write the joined output to " + temp.getFile().getFullPathName().toStdString());
+      }
+      stream.release(); // the writer owns the stream now
+
+      const int overlap = (int) (overlapSeconds * outSampleRate);
+      juce::AudioBuffer<float> tail;
+
+      for (int k = 0; k < numChunks; ++k) {
+        juce::AudioBuffer<float> part;
+        double partSampleRate = outSampleRate;
+        if (k == 0) {
+          part = std::move(first);
+        } else if (!audioutils::readFile(chunkFile(k), part, partSampleRate)) {
+          throw std::runtime_error("Failed to read processed chunk " + std::to_string(k + 1));
+        }
+        audioutils::conform(part, partSampleRate, outSampleRate, numChannels);
+
+        std::vector<juce::AudioBuffer<float>> joined {tail, part};
+        auto blended = k == 0 ? part : audioutils::concatenate(joined, tail.getNumSamples());
+
+        // hold back the overlap for the next chunk (but not after the last one)
+        const int keep = k + 1 < numChunks ? juce::jmin(overlap, blended.getNumSamples()) : 0;
+        const int toWrite = blended.getNumSamples() - keep;
+        if (!writer->writeFromAudioSampleBuffer(blended, 0, toWrite)) {
+          throw std::runtime_error("Failed to write the joined output");
+        }
+        tail.setSize(numChannels, keep);
+        for (int ch = 0; ch < numChannels; ++ch) {
+          tail.copyFrom(ch, 0, blended, ch, toWrite, keep);
+        }
+      }
+    }
+
+    if (!temp.overwriteTargetFileWithTemporary()) {
+      throw std::runtime_error("Failed to replace " + file.getFullPathName().toStdString());
+    }
+    dir.deleteRecursively();
+    return true;
+  }
+}
@@ -0,0 +1,582 @@
+/**
+ * @file
+ * @brief A small HTTP API on localhost, so scripts (e.g. in a DAW) can load a
+ * model, set its controls, submit files and collect the results without going
+ * through the window. The server has a model of its own, separate from the
+ * one shown in the UI, and every file is processed on a copy so the script's
+ * files are never touched.
+ *
+ *   GET    /status              the model, its controls and its load state
+ *   POST   /model               {"url": "..."} loads a model in the background
+ *   POST   /controls            {"<label>": value, ...} sets control values
+ *   POST   /jobs                {"file": "/path.wav", "controls": {...}} queues a file,
+ *                               the controls (optional) only apply to this job
+ *   GET    /jobs                every job and its state
+ *   GET    /jobs/<id>           one job; once finished, "result" is the processed file
+ *   GET    /jobs/<id>/result    the processed file itself
+ *   DELETE /jobs/<id>           cancels the job and deletes its result
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+
+#include "juce_core/juce_core.h"
+
+#include "ModelFactory.h"
+#include "Sweep.h"
+
+class ControlServer : private juce::Thread {
+public:
+  ControlServer() : juce::Thread("HARP control server") {}
+
+  ~ControlServer() override {
+    stop();
+  }
+
+  /**
+   * @brief Starts listening on 127.0.0.1:port.
+   * @return false if the port can't be opened (e.g. another HARP has it).
+   */
+  bool start(int port) {
+    if (isThreadRunning()) {
+      return true;
+    }
+    if (!m_listener.createListener(port, "127.0.0.1")) {
+      DBG("ControlServer: can't listen on port " << port);
+      return false;
+    }
+    DBG("ControlServer: listening on port " << port);
+    startThread();
+    return true;
+  }
+
+  void stop() {
+    m_listener.close();
+    stopThread(2000);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+      m_tasks.clear();
+      for (auto& job : m_jobs) {
+        job.second->flags.cancel.create();
+      }
+    }
+    m_taskAdded.notify_all();
+    // the helpers exit as soon as they see their cancel flags
+    for (auto& runner : m_runners) {
+      runner->stopThread(10000);
+    }
+    m_runners.clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& job : m_jobs) {
+      job.second->file.deleteFile();
+      job.second->flags.cleanup();
+    }
+    m_jobs.clear();
+  }
+
+private:
+  // jobs run at most this many at a time, anything else waits in the queue
+  static constexpr int maxParallelTasks = 4;
+
+  enum class JobState { Queued, Running, Finished, Cancelled, Failed };
+
+  struct Job {
+    juce::String id;
+    juce::File source;
+    // the copy that is processed in place, and becomes the result
+    juce::File file;
+    JobFlags flags;
+    std::atomic<JobState> state {JobState::Queued};
+    // deleted by the script, whoever finishes last cleans up
+    std::atomic<bool> removed {false};
+    juce::String error;
+  };
+
+  struct Response {
+    int code = 200;
+    juce::String contentType = "application/json";
+    juce::MemoryBlock body;
+
+    static Response json(const juce::var& value, int code = 200) {
+      Response r;
+      r.code = code;
+      auto text = juce::JSON::toString(value);
+      r.body.append(text.toRawUTF8(), text.getNumBytesAsUTF8());
+      return r;
+    }
+
+    static Response error(int code, const juce::String& message) {
+      auto obj = new juce::DynamicObject();
+      obj->setProperty("error", message);
+      return json(juce::var(obj), code);
+    }
+  };
+
+  struct Request {
+    juce::String method;
+    juce::StringArray path;
+    juce::StringPairArray headers;
+    juce::String body;
+  };
+
+  // a worker that takes tasks off the queue until the server stops
+  class Runner : public juce::Thread {
+  public:
+    Runner(ControlServer& server) : juce::Thread("HARP control job"), m_server(server) {}
+
+    void run() override {
+      while (auto task = m_server.nextTask()) {
+        task();
+      }
+    }
+
+  private:
+    ControlServer& m_server;
+  };
+
+  void run() override {
+    while (!threadShouldExit()) {
+      // blocks until a script connects, or the listener is closed
+      std::unique_ptr<juce::StreamingSocket> connection(m_listener.waitForNextConnection());
+      if (connection == nullptr) {
+        break;
+      }
+
+      Request request;
+      Response response;
+      if (!readRequest(*connection, request)) {
+        response = Response::error(400, "malformed request");
+      } else if (request.headers.containsKey("origin")) {
+        // scripts don't send an Origin, browsers always do. this keeps web pages
+        // from driving HARP through the user's browser
+        response = Response::error(403, "requests from web pages are not accepted");
+      } else if (!isLocalHost(request.headers["host"])) {
+        // a page whose domain was re-pointed at 127.0.0.1 (DNS rebinding) still sends its own name
+        response = Response::error(403, "only requests to localhost are accepted");
+      } else {
+        try {
+          response = handle(request);
+        } catch (const std::runtime_error& e) {
+          response = Response::error(400, e.what());
+        }
+      }
+      writeResponse(*connection, response);
+    }
+  }
+
+  Response handle(const Request& request) {
+    const auto& path = request.path;
+    const auto& method = request.method;
+
+    if (path.size() == 1 && path[0] == "status" && method == "GET") {
+      return Response::json(describeModel());
+    }
+    if (path.size() == 1 && path[0] == "model" && method == "POST") {
+      return loadModel(parseBody(request)["url"].toString());
+    }
+    if (path.size() == 1 && path[0] == "controls" && method == "POST") {
+      return setControls(parseBody(request));
+    }
+    if (path.size() == 1 && path[0] == "jobs" && method == "POST") {
+      auto body = parseBody(request);
+      return submit(body["file"].toString(), body["controls"]);
+    }
+    if (path.size() == 1 && path[0] == "jobs" && method == "GET") {
+      juce::Array<juce::var> jobs;
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (auto& job : m_jobs) {
+        jobs.add(describeJob(*job.second));
+      }
+      return Response::json(jobs);
+    }
+    if (path.size() >= 2 && path[0] == "jobs") {
+      auto job = findJob(path[1]);
+      if (job == nullptr) {
+        return Response::error(404, "no job " + path[1]);
+      }
+      if (path.size() == 2 && method == "GET") {
+        return Response::json(describeJob(*job));
+      }
+      if (path.size() == 2 && method == "DELETE") {
+        removeJob(job);
+        return Response::json(describeJob(*job));
+      }
+      if (path.size() == 3 && path[2] == "result" && method == "GET") {
+        if (job->state != JobState::Finished) {
+          return Response::error(409, "job " + job->id + " has not finished");
+        }
+        Response r;
+        r.contentType = "application/octet-stream";
+        if (!job->file.loadFileAsData(r.body)) {
+          return Response::error(500, "can't read " + job->file.getFullPathName());
+        }
+        return r;
+      }
+    }
+    return Response::error(404, "unknown request " + method + " /" + path.joinIntoString("/"));
+  }
+
+  Response loadModel(const juce::String& url) {
+    if (url.isEmpty()) {
+      return Response::error(400, "url is missing");
+    }
+
+    auto model = models::create(url.toStdString());
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_model = model;
+      m_modelUrl = url;
+      m_modelState = "loading";
+      m_modelError.clear();
+    }
+
+    addTask([this, model, url] {
+      juce::String error;
+      try {
+        model->load({{"url", url.toStdString()}});
+      } catch (const std::runtime_error& e) {
+        error = e.what();
+      }
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      // a newer load replaced this one while it ran
+      if (m_model != model) {
+        return;
+      }
+      m_modelState = error.isEmpty() ? "ready" : "error";
+      m_modelError = error;
+    });
+    return Response::json(describeModel(), 202);
+  }
+
+  Response setControls(const juce::var& values) {
+    auto model = readyModel();
+    auto ctrls = *model->controls();
+    applyValues(ctrls, values);
+    model->ctrlStore().set(std::move(ctrls));
+    return Response::json(describeModel());
+  }
+
+  Response submit(const juce::String& path, const juce::var& values) {
+    juce::File source(path);
+    if (!juce::File::isAbsolutePath(path) || !source.existsAsFile()) {
+      return Response::error(400, "no file at \"" + path + "\"");
+    }
+
+    auto model = readyModel();
+    auto ctrls = std::make_shared<CtrlList>(*model->controls());
+    if (values.isObject()) {
+      applyValues(*ctrls, values);
+    }
+
+    auto job = std::make_shared<Job>();
+    job->id = juce::Uuid().toString().substring(0, 8);
+    job->source = source;
+    job->file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                  .getChildFile("harp_control_" + job->id + source.getFileExtension());
+    job->flags = JobFlags::makeUnique();
+    if (!source.copyFileTo(job->file)) {
+      return Response::error(500, "can't copy " + path + " to " + job->file.getFullPathName());
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_jobs[job->id] = job;
+    }
+    addTask([model, ctrls, job] {
+      // a job that was removed while it was queued never runs, removeJob has cleaned up after it
+      auto queued = JobState::Queued;
+      if (!job->state.compare_exchange_strong(queued, JobState::Running)) {
+        return;
+      }
+      try {
+        bool processed = model->process(job->file, *ctrls, job->flags);
+        job->state = processed ? JobState::Finished : JobState::Cancelled;
+      } catch (const std::runtime_error& e) {
+        job->error = e.what();
+        job->state = JobState::Failed;
+      }
+      // removeJob left the clean up to us if it saw the job running
+      if (job->removed) {
+        job->file.deleteFile();
+        job->flags.cleanup();
+      }
+    });
+    return Response::json(describeJob(*job), 202);
+  }
+
+  void removeJob(std::shared_ptr<Job> job) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_jobs.erase(job->id);
+    }
+    job->removed = true;
+
+    // a queued job is cancelled before it can start, so nothing else touches its files
+    auto queued = JobState::Queued;
+    if (job->state.compare_exchange_strong(queued, JobState::Cancelled)) {
+      job->file.deleteFile();
+      job->flags.cleanup();
+      return;
+    }
+
+    job->flags.cancel.create();
+    // a running job still writes to its file, it cleans up once it's done (it sees removed,
+    // since it only checks after leaving Running). one that is done already is ours to clean up.
+    if (job->state != JobState::Running) {
+      job->file.deleteFile();
+      job->flags.cleanup();
+    }
+  }
+
+  // whether the Host header of a request names us (with or without the port)
+  static bool isLocalHost(const juce::String& host) {
+    auto name = host.upToFirstOccurrenceOf(":", false, false);
+    return name == "127.0.0.1" || name.equalsIgnoreCase("localhost");
+  }
+
+  // the server's model, once it has loaded.
+  // will throw a std::runtime_error if there is none
+  std::shared_ptr<Wave2Wave> readyModel() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_model == nullptr || m_modelState != "ready") {
+      throw std::runtime_error(m_modelState == "loading" ? "the model is still loading" : "no model is loaded");
+    }
+    return m_model;
+  }
+
+  std::shared_ptr<Job> findJob(const juce::String& id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_jobs.find(id);
+    return it == m_jobs.end() ? nullptr : it->second;
+  }
+
+  // sets the controls named in values ({"<label>": value}).
+  // will throw a std::runtime_error for a label the model doesn't have
+  static void applyValues(CtrlList& ctrls, const juce::var& values) {
+    auto* object = values.getDynamicObject();
+    if (object == nullptr) {
+      throw std::runtime_error("expected an object of {\"<label>\": value}");
+    }
+    for (const auto& property : object->getProperties()) {
+      auto label = property.name.toString().toStdString();
+      auto it = std::find_if(ctrls.begin(), ctrls.end(),
+                             [&label](const auto& pair) { return pair.second->label == label; });
+      if (it == ctrls.end()) {
+        throw std::runtime_error("the model has no control \"" + label + "\"");
+      }
+
+      std::shared_ptr<const Ctrl> edited;
+      if (auto textBox = dynamic_cast<const TextBoxCtrl*>(it->second.get())) {
+        auto copy = std::make_shared<TextBoxCtrl>(*textBox);
+        copy->value = property.value.toString().toStdString();
+        edited = copy;
+      } else {
+        edited = sweep::withValue(*it->second, property.value);
+      }
+      if (edited == nullptr) {
+        throw std::runtime_error("the control \"" + label + "\" can't be set");
+      }
+      it->second = edited;
+    }
+  }
+
+  juce::var describeModel() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto obj = new juce::DynamicObject();
+    obj->setProperty("model", m_modelUrl);
+    obj->setProperty("state", m_modelState);
+    if (m_modelError.isNotEmpty()) {
+      obj->setProperty("error", m_modelError);
+    }
+
+    juce::Array<juce::var> controls;
+    if (m_model != nullptr && m_modelState == "ready") {
+      obj->setProperty("name", juce::String(m_model->card().name));
+      for (const auto& pair : *m_model->controls()) {
+        auto ctrl = new juce::DynamicObject();
+        ctrl->setProperty("label", juce::String(pair.second->label));
+        if (auto slider = dynamic_cast<const SliderCtrl*>(pair.second.get())) {
+          ctrl->setProperty("type", "slider");
+          ctrl->setProperty("value", slider->value);
+          ctrl->setProperty("minimum", slider->minimum);
+          ctrl->setProperty("maximum", slider->maximum);
+        } else if (auto numberBox = dynamic_cast<const NumberBoxCtrl*>(pair.second.get())) {
+          ctrl->setProperty("type", "number_box");
+          ctrl->setProperty("value", numberBox->value);
+          ctrl->setProperty("minimum", numberBox->min);
+          ctrl->setProperty("maximum", numberBox->max);
+        } else if (auto toggle = dynamic_cast<const ToggleCtrl*>(pair.second.get())) {
+          ctrl->setProperty("type", "toggle");
+          ctrl->setProperty("value", toggle->value);
+        } else if (auto comboBox = dynamic_cast<const ComboBoxCtrl*>(pair.second.get())) {
+          juce::StringArray options;
+          for (const auto& option : comboBox->options) {
+            options.add(option);
+          }
+          ctrl->setProperty("type", "dropdown");
+          ctrl->setProperty("value", juce::String(comboBox->value));
+          ctrl->setProperty("options", options);
+        } else if (auto textBox = dynamic_cast<const TextBoxCtrl*>(pair.second.get())) {
+          ctrl->setProperty("type", "text");
+          ctrl->setProperty("value", juce::String(textBox->value));
+        } else {
+          // audio inputs are filled in with the job's file
+          ctrl->setProperty("type", "audio_in");
+        }
+        controls.add(juce::var(ctrl));
+      }
+    }
+    obj->setProperty("controls", controls);
+    return juce::var(obj);
+  }
+
+  static juce::var describeJob(const Job& job) {
+    static const char* names[] = {"queued", "running", "finished", "cancelled", "failed"};
+    auto state = job.state.load();
+    auto obj = new juce::DynamicObject();
+    obj->setProperty("id", job.id);
+    obj->setProperty("file", job.source.getFullPathName());
+    obj->setProperty("state", names[(int) state]);
+    if (state == JobState::Finished) {
+      obj->setProperty("result", job.file.getFullPathName());
+    }
+    if (state == JobState::Failed) {
+      obj->setProperty("error", job.error);
+    }
+    return juce::var(obj);
+  }
+
+  static juce::var parseBody(const Request& request) {
+    juce::var body;
+    auto result = juce::JSON::parse(request.body, body);
+    if (result.failed() || !body.isObject()) {
+      throw std::runtime_error("the body is not a json object: " + result.getErrorMessage().toStdString());
+    }
+    return body;
+  }
+
+  void addTask(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.push_back(std::move(task));
+      // runners are only started when there is more queued than they can take
+      if ((int) m_runners.size() < maxParallelTasks && m_idleRunners < (int) m_tasks.size()) {
+        m_runners.push_back(std::make_unique<Runner>(*this));
+        m_runners.back()->startThread();
+      }
+    }
+    m_taskAdded.notify_one();
+  }
+
+  // blocks until there is something to do. returns nothing once the server stops
+  std::function<void()> nextTask() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_idleRunners;
+    m_taskAdded.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+    --m_idleRunners;
+    if (m_stopping) {
+      return {};
+    }
+    auto task = std::move(m_tasks.front());
+    m_tasks.pop_front();
+    return task;
+  }
+
+  static bool readRequest(juce::StreamingSocket& socket, Request& request) {
+    constexpr int timeoutMs = 5000;
+    constexpr int maxHeaderBytes = 64 * 1024;
+    constexpr int maxBodyBytes = 1024 * 1024;
+
+    juce::MemoryBlock data;
+    char buffer[4096];
+    int headerEnd = -1;
+    while (headerEnd < 0) {
+      if (socket.waitUntilReady(true, timeoutMs) != 1) {
+        return false;
+      }
+      int n = socket.read(buffer, (int) sizeof(buffer), false);
+      if (n <= 0) {
+        return false;
+      }
+      data.append(buffer, (size_t) n);
+      headerEnd = data.toString().indexOf("\r\n\r\n");
+      if (headerEnd < 0 && (int) data.getSize() > maxHeaderBytes) {
+        return false;
+      }
+    }
+
+    auto text = data.toString();
+    auto lines = juce::StringArray::fromLines(text.substring(0, headerEnd));
+    auto requestLine = juce::StringArray::fromTokens(lines[0], " ", "");
+    if (requestLine.size() < 2) {
+      return false;
+    }
+    request.method = requestLine[0].toUpperCase();
+    // the query string is not used
+    request.path = juce::StringArray::fromTokens(requestLine[1].upToFirstOccurrenceOf("?", false, false), "/", "");
+    request.path.removeEmptyStrings();
+    for (int i = 0; i < request.path.size(); ++i) {
+      request.path.set(i, juce::URL::removeEscapeChars(request.path[i]));
+    }
+    for (int i = 1; i < lines.size(); ++i) {
+      request.headers.set(lines[i].upToFirstOccurrenceOf(":", false, false).trim().toLowerCase(),
+                          lines[i].fromFirstOccurrenceOf(":", false, false).trim());
+    }
+
+    const int bodyStart = headerEnd + 4;
+    const int contentLength = request.headers["content-length"].getIntValue();
+    if (contentLength < 0 || contentLength > maxBodyBytes) {
+      return false;
+    }
+    while ((int) data.getSize() < bodyStart + contentLength) {
+      if (socket.waitUntilReady(true, timeoutMs) != 1) {
+        return false;
+      }
+      int n = socket.read(buffer, (int) sizeof(buffer), false);
+      if (n <= 0) {
+        return false;
+      }
+      data.append(buffer, (size_t) n);
+    }
+    request.body = juce::String::fromUTF8(static_cast<const char*>(data.getData()) + bodyStart, contentLength);
+    return true;
+  }
+
+  static void writeResponse(juce::StreamingSocket& socket, const Response& response) {
+    static const std::map<int, const char*> reasons = {
+      {200, "OK"}, {202, "Accepted"}, {400, "Bad Request"}, {403, "Forbidden"},
+      {404, "Not Found"}, {409, "Conflict"}, {500, "Internal Server Error"}};
+    auto reason = reasons.count(response.code) ? reasons.at(response.code) : "";
+
+    juce::String header;
+    header << "HTTP/1.1 " << response.code << " " << reason << "\r\n"
+           << "Content-Type: " << response.contentType << "\r\n"
+           << "Content-Length: " << (juce::int64) response.body.getSize() << "\r\n"
+           << "Connection: close\r\n\r\n";
+    socket.write(header.toRawUTF8(), (int) header.getNumBytesAsUTF8());
+    if (response.body.getSize() > 0) {
+      socket.write(response.body.getData(), (int) response.body.getSize());
+    }
+  }
+
+  juce::StreamingSocket m_listener;
+
+  std::mutex m_mutex;
+  std::shared_ptr<Wave2Wave> m_model;
+  juce::String m_modelUrl;
+  juce::String m_modelState {"none"};
+  juce::String m_modelError;
+  std::map<juce::String, std::shared_ptr<Job>> m_jobs;
+
+  std::deque<std::function<void()>> m_tasks;
+  std::condition_variable m_taskAdded;
+  std::vector<std::unique_ptr<Runner>> m_runners;
+  int m_idleRunners = 0;
+  bool m_stopping = false;
+};
@@ -41,7 +41,10 @@ public:
 
   CtrlComponent() {}
 
-  void setModel(std::shared_ptr<WebWave2Wave> model) {
+  // called after a control value was stored in the model (e.g. to start a live preview)
+  std::function<void()> onCtrlChanged;
+
+  void setModel(std::shared_ptr<Wave2Wave> model) {
     mModel = model;
   }
 
@@ -55,12 +58,12 @@ public:
       return;
     }
 
-    auto &ctrlList = mModel->controls();
+    auto ctrlList = mModel->controls();
   
-    for (const auto &pair : ctrlList) {
+    for (const auto &pair : *ctrlList) {
       auto ctrlPtr = pair.second;
       // SliderCtrl
-        if (auto sliderCtrl = dynamic_cast<SliderCtrl*>(ctrlPtr.get())) {
+        if (auto sliderCtrl = dynamic_cast<const SliderCtrl*>(ctrlPtr.get())) {
             auto sliderWithLabel = std::make_unique<SliderWithLabel>(sliderCtrl->label, juce::Slider::RotaryHorizontalVerticalDrag);
             // auto& label = sliderWithLabel->getLabel();
             // label.setColour(juce::Label::ColourIds::textColourId, mHARPLookAndFeel.textHeaderColor);
@@ -75,7 +78,7 @@ public:
             DBG("Slider: " + sliderCtrl->label + " added");
 
       // ToggleCtrl
-      } else if (auto toggleCtrl = dynamic_cast<ToggleCtrl*>(ctrlPtr.get())) {
+      } else if (auto toggleCtrl = dynamic_cast<const ToggleCtrl*>(ctrlPtr.get())) {
           auto toggle = std::make_unique<juce::ToggleButton>();
           toggle->setName(toggleCtrl->id.toString());
           toggle->setTitle(toggleCtrl->label);
@@ -87,7 +90,7 @@ public:
           DBG("Toggle: " + toggleCtrl->label + " added");
 
       // TextBoxCtrl
-      } else if (auto textBoxCtrl = dynamic_cast<TextBoxCtrl*>(ctrlPtr.get())) {
+      } else if (auto textBoxCtrl = dynamic_cast<const TextBoxCtrl*>(ctrlPtr.get())) {
           auto textCtrl = std::make_unique<TitledTextBox>();
           textCtrl->setName(textBoxCtrl->id.toString());
           textCtrl->setTitle(textBoxCtrl->label);
@@ -98,7 +101,7 @@ public:
           DBG("Text Box: " + textBoxCtrl->label + " added");
 
       // ComboBoxCtrl
-      } else if (auto comboBoxCtrl = dynamic_cast<ComboBoxCtrl*>(ctrlPtr.get())) {
+      } else if (auto comboBoxCtrl = dynamic_cast<const ComboBoxCtrl*>(ctrlPtr.get())) {
           auto comboBox = std::make_unique<juce::ComboBox>();
           comboBox->setName(comboBoxCtrl->id.toString());
           for (const auto &option : comboBoxCtrl->options) {
@@ -210,55 +213,41 @@ public:
 
 
 
+  // every edit goes through the model's control store. jobs that are already
+  // running keep the snapshot they were given, so nothing here can race with them.
   void buttonClicked(Button *button) override {
     auto id = juce::Uuid(button->getName().toStdString());
-
-    CtrlList &ctrls = mModel->controls();
-    auto pair = mModel->findCtrlByUuid(id); 
-    if (pair == ctrls.end()) {
-      DBG("buttonClicked: ctrl not found");
-      return;
-    }
-    auto ctrl = pair->second;
-    if (auto toggleCtrl = dynamic_cast<ToggleCtrl*>(ctrl.get())) {
-      toggleCtrl->value = button->getToggleState();
+    bool updated = mModel->ctrlStore().update<ToggleCtrl>(id, [button] (ToggleCtrl& ctrl) {
+      ctrl.value = button->getToggleState();
+    });
+    if (updated) {
+      ctrlChanged();
     } else {
-      DBG("buttonClicked: ctrl is not a toggle");
+      DBG("buttonClicked: ctrl not found or not a toggle");
     }
-
   }
 
   void comboBoxChanged(ComboBox *comboBox) override {
     auto id = juce::Uuid(comboBox->getName().toStdString());
-
-    CtrlList &ctrls = mModel->controls();
-    auto pair = mModel->findCtrlByUuid(id);
-    if (pair == ctrls.end()) {
-      DBG("comboBoxChanged: ctrl not found");
-      return;
-    }
-    auto ctrl = pair->second;
-    if (auto comboBoxCtrl = dynamic_cast<ComboBoxCtrl*>(ctrl.get())) {
-      comboBoxCtrl->value = comboBox->getText().toStdString();
+    bool updated = mModel->ctrlStore().update<ComboBoxCtrl>(id, [comboBox] (ComboBoxCtrl& ctrl) {
+      ctrl.value = comboBox->getText().toStdString();
+    });
+    if (updated) {
+      ctrlChanged();
     } else {
-      DBG("comboBoxChanged: ctrl is not a combobox");
+      DBG("comboBoxChanged: ctrl not found or not a combobox");
     }
   }
 
   void textEditorTextChanged (TextEditor& textEditor) override {
     auto id = juce::Uuid(textEditor.getName().toStdString());
-
-    CtrlList &ctrls = mModel->controls();
-    auto pair = mModel->findCtrlByUuid(id);
-    if (pair == ctrls.end()) {
-      DBG("textEditorTextChanged: ctrl not found");
-      return;
-    }
-    auto ctrl = pair->second;
-    if (auto textBoxCtrl = dynamic_cast<TextBoxCtrl*>(ctrl.get())) {
-      textBoxCtrl->value = textEditor.getText().toStdString();
+    bool updated = mModel->ctrlStore().update<TextBoxCtrl>(id, [&textEditor] (TextBoxCtrl& ctrl) {
+      ctrl.value = textEditor.getText().toStdString();
+    });
+    if (updated) {
+      ctrlChanged();
     } else {
-      DBG("textEditorTextChanged: ctrl is not a text box");
+      DBG("textEditorTextChanged: ctrl not found or not a text box");
     }
   }
 
@@ -268,26 +257,26 @@ public:
 
   void sliderDragEnded(Slider* slider) override {
     auto id = juce::Uuid(slider->getName().toStdString());
-
-    CtrlList &ctrls = mModel->controls();
-    auto pair = mModel->findCtrlByUuid(id);
-    if (pair == ctrls.end()) {
-      DBG("sliderDragEnded: ctrl not found");
-      return;
-    }
-    auto ctrl = pair->second;
-    if (auto sliderCtrl = dynamic_cast<SliderCtrl*>(ctrl.get())) {
-      sliderCtrl->value = slider->getValue();
-    } else if (auto numberBoxCtrl = dynamic_cast<NumberBoxCtrl*>(ctrl.get())) {
-      numberBoxCtrl->value = slider->getValue();
+    auto value = slider->getValue();
+    auto& store = mModel->ctrlStore();
+    bool updated = store.update<SliderCtrl>(id, [value] (SliderCtrl& ctrl) { ctrl.value = value; })
+                   || store.update<NumberBoxCtrl>(id, [value] (NumberBoxCtrl& ctrl) { ctrl.value = value; });
+    if (updated) {
+      ctrlChanged();
     } else {
-      DBG("sliderDragEnded: ctrl is not a slider");
+      DBG("sliderDragEnded: ctrl not found or not a slider");
     }
   }
 
 private:
+  void ctrlChanged() {
+    if (onCtrlChanged) {
+      onCtrlChanged();
+    }
+  }
+
   // ToolbarSliderStyle toolbarSliderStyle;
-  std::shared_ptr<WebWave2Wave> mModel {nullptr};
+  std::shared_ptr<Wave2Wave> mModel {nullptr};
 
   juce::Label headerLabel;
   // HARPLookAndFeel mHARPLookAndFeel;
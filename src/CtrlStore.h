@@ -0,0 +1,129 @@
+/**
+ * @file
+ * @brief The controls of a model and the store that holds their values.
+ * The UI edits the store, and every job gets a snapshot of it when it is
+ * submitted. Snapshots are never modified, so any number of jobs can read
+ * them while the UI keeps editing.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+
+#include "juce_core/juce_core.h"
+
+
+struct Ctrl {
+  juce::Uuid id {""};
+  std::string label {""};
+  virtual ~Ctrl() = default; // virtual destructor
+};
+
+struct SliderCtrl : public Ctrl {
+  double minimum;
+  double maximum;
+  double step;
+  double value;
+};
+
+struct TextBoxCtrl : public Ctrl {
+  std::string value;
+};
+
+struct AudioInCtrl : public Ctrl {
+  std::string value;
+};
+
+
+struct NumberBoxCtrl : public Ctrl {
+  double min;
+  double max;
+  double value;
+};
+
+struct ToggleCtrl : public Ctrl {
+  bool value;
+};
+
+struct ComboBoxCtrl : public Ctrl {
+  std::vector<std::string> options;
+  std::string value;
+};
+
+
+using CtrlList = std::vector<std::pair<juce::Uuid, std::shared_ptr<const Ctrl>>>;
+// an immutable copy of a model's controls, taken when a job is submitted
+using CtrlSnapshot = std::shared_ptr<const CtrlList>;
+
+
+/**
+ * @class CtrlStore
+ * @brief Copy-on-write store of control values with constant time lookup by id.
+ *
+ * Controls that are part of a snapshot are never changed. An edit copies the one
+ * control it touches and publishes a new list that shares all the others, so taking
+ * a snapshot is just copying a pointer.
+ */
+class CtrlStore {
+public:
+  CtrlStore() : m_ctrls(std::make_shared<const CtrlList>()) {}
+
+  // replaces all controls, e.g. after loading a model
+  void set(CtrlList ctrls) {
+    std::unordered_map<juce::String, size_t> index;
+    for (size_t i = 0; i < ctrls.size(); ++i) {
+      index[ctrls[i].first.toString()] = i;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ctrls = std::make_shared<const CtrlList>(std::move(ctrls));
+    m_index = std::move(index);
+  }
+
+  void clear() { set({}); }
+
+  CtrlSnapshot snapshot() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ctrls;
+  }
+
+  std::shared_ptr<const Ctrl> find(const juce::Uuid& id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(id.toString());
+    return it == m_index.end() ? nullptr : (*m_ctrls)[it->second].second;
+  }
+
+  /**
+   * @brief Changes the control with the given id, if it is a CtrlType.
+   * @param edit is called with a fresh copy of the control, which replaces the old one.
+   * @return false if there is no such control, or it has a different type.
+   */
+  template <typename CtrlType, typename EditFunction>
+  bool update(const juce::Uuid& id, EditFunction&& edit) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(id.toString());
+    if (it == m_index.end()) {
+      return false;
+    }
+
+    auto current = std::dynamic_pointer_cast<const CtrlType>((*m_ctrls)[it->second].second);
+    if (current == nullptr) {
+      return false;
+    }
+
+    auto edited = std::make_shared<CtrlType>(*current);
+    edit(*edited);
+
+    auto ctrls = std::make_shared<CtrlList>(*m_ctrls);
+    (*ctrls)[it->second].second = std::move(edited);
+    m_ctrls = std::move(ctrls);
+    return true;
+  }
+
+private:
+  mutable std::mutex m_mutex;
+  CtrlSnapshot m_ctrls;
+  // uuid string -> position in m_ctrls. positions never change between calls to set()
+  std::unordered_map<juce::String, size_t> m_index;
+};
@@ -0,0 +1,163 @@
+/**
+ * @file
+ * @brief Deadlines for remote operations. A single thread keeps track of
+ * every pending deadline and runs its callback when it expires, so deadlines
+ * work from any thread, including worker threads without a message loop.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+#include "juce_core/juce_core.h"
+
+class DeadlineScheduler : private juce::Thread {
+public:
+  using Id = juce::uint64;
+
+  DeadlineScheduler() : juce::Thread("HARP deadlines") {}
+
+  ~DeadlineScheduler() override {
+    {
+      // under the lock, so the thread can't miss the wake up
+      std::lock_guard<std::mutex> lock(m_mutex);
+      signalThreadShouldExit();
+    }
+    m_changed.notify_all();
+    stopThread(1000);
+  }
+
+  /**
+   * @brief Runs callback on the scheduler's thread after seconds, unless cancel() is called first.
+   * callbacks should be quick, since they hold up every other deadline.
+   */
+  Id schedule(double seconds, std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // the thread is only started for the first deadline
+    if (!isThreadRunning()) {
+      startThread();
+    }
+    auto id = ++m_lastId;
+    m_deadlines[id] = {Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)),
+                       std::move(callback)};
+    m_changed.notify_all();
+    return id;
+  }
+
+  // once this returns, the callback of id is not running and won't run anymore
+  void cancel(Id id) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_deadlines.erase(id);
+    m_changed.wait(lock, [this, id] { return m_firing != id; });
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Deadline {
+    Clock::time_point when;
+    std::function<void()> callback;
+  };
+
+  void run() override {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!threadShouldExit()) {
+      auto next = std::min_element(m_deadlines.begin(), m_deadlines.end(),
+                                   [] (const auto& a, const auto& b) { return a.second.when < b.second.when; });
+      if (next == m_deadlines.end()) {
+        m_changed.wait(lock);
+        continue;
+      }
+      if (Clock::now() < next->second.when) {
+        m_changed.wait_until(lock, next->second.when);
+        continue;
+      }
+
+      auto callback = std::move(next->second.callback);
+      m_firing = next->first;
+      m_deadlines.erase(next);
+
+      lock.unlock();
+      callback();
+      lock.lock();
+
+      m_firing = 0;
+      m_changed.notify_all();
+    }
+  }
+
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  std::map<Id, Deadline> m_deadlines;
+  Id m_lastId {0};
+  // the deadline whose callback is running right now (0 = none)
+  Id m_firing {0};
+};
+
+
+/**
+ * @class StageDeadlines
+ * @brief The deadline of a job that goes through stages (connect, upload, ...),
+ * each with its own time limit. Entering a stage replaces the deadline of the
+ * previous one.
+ */
+class StageDeadlines {
+public:
+  // onExpired is called on the scheduler's thread with the stage that ran out of time
+  StageDeadlines(DeadlineScheduler& scheduler, std::function<void(const juce::String&)> onExpired)
+      : m_scheduler(scheduler), m_onExpired(std::move(onExpired)) {}
+
+  ~StageDeadlines() { stop(); }
+
+  // a limit of 0 (or less) means the stage can take as long as it likes
+  void enter(const juce::String& stage, double limitSeconds) {
+    stop();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stage = stage;
+    if (limitSeconds > 0) {
+      m_id = m_scheduler.schedule(limitSeconds, [this, stage] {
+        {
+          std::lock_guard<std::mutex> expiredLock(m_mutex);
+          m_expired = stage;
+        }
+        m_onExpired(stage);
+      });
+    }
+  }
+
+  void stop() {
+    DeadlineScheduler::Id id;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      id = m_id;
+      m_id = 0;
+    }
+    if (id != 0) {
+      m_scheduler.cancel(id);
+    }
+  }
+
+  juce::String currentStage() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stage;
+  }
+
+  // the stage that ran out of time, or an empty string
+  juce::String expiredStage() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_expired;
+  }
+
+private:
+  DeadlineScheduler& m_scheduler;
+  std::function<void(const juce::String&)> m_onExpired;
+
+  mutable std::mutex m_mutex;
+  DeadlineScheduler::Id m_id {0};
+  juce::String m_stage;
+  juce::String m_expired;
+};
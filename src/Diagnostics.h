@@ -0,0 +1,171 @@
+/**
+ * @file
+ * @brief Startup timing and idle wakeups. Milestones are marked while HARP
+ * comes up, and once the window can take input a one line report is appended
+ * to startup.log in HARP's log folder, so time-to-interactive can be tracked
+ * across launches. idle.log gets a line per session with how often HARP woke
+ * up while it had nothing to do (which should be never).
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include "juce_core/juce_core.h"
+
+namespace diagnostics {
+
+  // as close to process start as we can get without platform specific calls:
+  // inline variables are initialised before main() runs
+  inline const double launchTimeMs = juce::Time::getMillisecondCounterHiRes();
+
+  inline double millisecondsSinceLaunch() {
+    return juce::Time::getMillisecondCounterHiRes() - launchTimeMs;
+  }
+
+  // "2026-10-18 10:00:00 HARP 1.0", the start of every line in the logs below
+  inline juce::String logLinePrefix() {
+    return juce::Time::getCurrentTime().formatted("%Y-%m-%d %H:%M:%S")
+           + " " + juce::String(JUCE_APPLICATION_NAME_STRING) + " " + juce::String(JUCE_APPLICATION_VERSION_STRING);
+  }
+
+  // appends line to one of HARP's diagnostic logs, keeping only the most recent lines
+  inline void appendToLog(const juce::File& file, const juce::String& line) {
+    file.getParentDirectory().createDirectory();
+
+    constexpr juce::int64 maxLogBytes = 64 * 1024;
+    if (file.getSize() > maxLogBytes) {
+      juce::StringArray lines;
+      lines.addLines(file.loadFileAsString());
+      lines.removeEmptyStrings();
+      lines.removeRange(0, lines.size() / 2);
+      file.replaceWithText(lines.joinIntoString("\n") + "\n");
+    }
+    file.appendText(line + "\n");
+    DBG(file.getFileNameWithoutExtension() + ": " + line);
+  }
+
+  class StartupTimer {
+  public:
+    static StartupTimer& get() {
+      static StartupTimer instance;
+      return instance;
+    }
+
+    // records how long it took to get to milestone. ignored once the report is written.
+    void mark(const juce::String& milestone) {
+      if (m_reported) {
+        return;
+      }
+      m_marks.add({milestone, millisecondsSinceLaunch()});
+      DBG("Startup: " + milestone + " after " + juce::String(m_marks.getLast().ms, 1) + " ms");
+    }
+
+    // marks the window as interactive and writes the report. only the first call counts.
+    void interactive() {
+      if (m_reported) {
+        return;
+      }
+      mark("interactive");
+      m_reported = true;
+      appendToLog(getLogFile(), report());
+    }
+
+    // e.g. "2026-10-18 10:00:00 HARP 1.0: interactive after 212.3 ms (initialise 4.1, window 180.2, interactive 212.3)"
+    juce::String report() const {
+      juce::StringArray parts;
+      for (const auto& mark : m_marks) {
+        parts.add(mark.name + " " + juce::String(mark.ms, 1));
+      }
+      auto total = m_marks.isEmpty() ? 0.0 : m_marks.getLast().ms;
+      return logLinePrefix() + ": interactive after " + juce::String(total, 1) + " ms (" + parts.joinIntoString(", ") + ")";
+    }
+
+    static juce::File getLogFile() {
+      return juce::FileLogger::getSystemLogFileFolder().getChildFile("HARP").getChildFile("startup.log");
+    }
+
+  private:
+    struct Mark {
+      juce::String name;
+      double ms;
+    };
+
+    juce::Array<Mark> m_marks;
+    bool m_reported {false};
+  };
+
+
+  /**
+   * @class IdleMonitor
+   * @brief Keeps track of what is keeping HARP awake. Anything that needs
+   * periodic callbacks (a timer, the audio device) is an activity, and says
+   * when it starts and stops. Every periodic callback counts as a wakeup.
+   * When no activity is running HARP is idle, and should not wake up at all.
+   */
+  class IdleMonitor {
+  public:
+    static IdleMonitor& get() {
+      static IdleMonitor instance;
+      return instance;
+    }
+
+    void setActive(const juce::String& activity, bool active) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      const bool wasIdle = m_active.isEmpty();
+      if (active) {
+        m_active.addIfNotAlreadyThere(activity);
+      } else {
+        m_active.removeString(activity);
+      }
+
+      if (wasIdle && !m_active.isEmpty()) {
+        m_idleMs += millisecondsSinceLaunch() - m_idleSince;
+      } else if (!wasIdle && m_active.isEmpty()) {
+        m_idleSince = millisecondsSinceLaunch();
+      }
+    }
+
+    // called at the start of every periodic callback
+    void wakeup(const char* source) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      ++m_wakeups;
+      if (m_active.isEmpty()) {
+        ++m_idleWakeups;
+        DBG("IdleMonitor: " << source << " woke up while HARP was idle");
+      }
+    }
+
+    juce::int64 idleWakeups() const {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_idleWakeups;
+    }
+
+    // e.g. "2026-10-18 10:00:00 HARP 1.0: 0 of 1234 wakeups while idle (idle 812.4 of 900.0 s)"
+    juce::String report() const {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      const auto now = millisecondsSinceLaunch();
+      const auto idleMs = m_idleMs + (m_active.isEmpty() ? now - m_idleSince : 0.0);
+      return logLinePrefix() + ": " + juce::String(m_idleWakeups) + " of " + juce::String(m_wakeups)
+             + " wakeups while idle (idle " + juce::String(idleMs / 1000.0, 1) + " of " + juce::String(now / 1000.0, 1) + " s)";
+    }
+
+    // appends the report for this session to idle.log
+    void writeReport() const {
+      appendToLog(getLogFile(), report());
+    }
+
+    static juce::File getLogFile() {
+      return juce::FileLogger::getSystemLogFileFolder().getChildFile("HARP").getChildFile("idle.log");
+    }
+
+  private:
+    mutable std::mutex m_mutex;
+    juce::StringArray m_active;
+    juce::int64 m_wakeups {0};
+    juce::int64 m_idleWakeups {0};
+    // time spent idle before the current idle stretch, and when that started
+    double m_idleMs {0};
+    double m_idleSince {0};
+  };
+}
@@ -0,0 +1,230 @@
+/**
+ * @file
+ * @brief Runs the gradiojuce helper as a child process. The helper's output
+ * is read on its own thread while it runs, so the caller can keep an eye on
+ * the cancel flag. A cancelled helper gets a short grace period to cancel its
+ * job on the server, after which it is killed along with everything it started.
+ */
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "juce_core/juce_core.h"
+
+#if ! JUCE_WINDOWS
+  #include <signal.h>
+#endif
+
+// what the helper says about a running job, in "HARP.Progress {json}" lines
+struct HelperProgress {
+  // -1 for anything the space didn't tell us
+  int queuePosition {-1};
+  int queueSize {-1};
+  double etaSeconds {-1};
+  double percent {-1};
+
+  // fills progress from line, if it is a progress line
+  static bool parse(const juce::String& line, HelperProgress& progress) {
+    if (!line.startsWith("HARP.Progress ")) {
+      return false;
+    }
+    auto json = juce::JSON::parse(line.fromFirstOccurrenceOf("HARP.Progress ", false, false));
+    if (!json.isObject()) {
+      return false;
+    }
+    auto number = [&json] (const char* key) {
+      auto value = json.getProperty(key, juce::var());
+      return value.isVoid() ? -1.0 : (double) value;
+    };
+    progress.queuePosition = (int) number("queue_position");
+    progress.queueSize = (int) number("queue_size");
+    progress.etaSeconds = number("eta");
+    progress.percent = number("percent");
+    return true;
+  }
+
+  // e.g. "position 3 of 7 in the queue, about 40 s left" or "42% done, about 12 s left"
+  juce::String describe() const {
+    juce::StringArray parts;
+    if (percent >= 0) {
+      parts.add(juce::String(juce::roundToInt(percent)) + "% done");
+    } else if (queuePosition >= 0) {
+      parts.add("position " + juce::String(queuePosition + 1)
+                + (queueSize > 0 ? " of " + juce::String(queueSize) : juce::String()) + " in the queue");
+    }
+    if (etaSeconds >= 0) {
+      parts.add("about " + juce::String(juce::roundToInt(etaSeconds)) + " s left");
+    }
+    return parts.joinIntoString(", ");
+  }
+};
+
+
+class HelperProcess {
+public:
+  struct Result {
+    // the last lines of output, enough to find an error message in.
+    // (all of it goes to onLine as it arrives, nothing else keeps it around)
+    juce::String output;
+    juce::uint32 exitCode {0};
+    // time from the cancel flag showing up to the helper being gone (-1 if it wasn't cancelled)
+    double cancelLatencyMs {-1};
+    // the helper didn't exit within the grace period and had to be killed
+    bool killed {false};
+
+    bool cancelled() const { return cancelLatencyMs >= 0; }
+  };
+
+  /**
+   * @brief Runs command and waits for the helper to exit.
+   * @param cancelFlag once this file exists, the helper has gracePeriodMs to exit on
+   * its own before its whole process tree is killed. Either way run() returns shortly
+   * after, even if the helper hangs. Pass an empty File for jobs that can't be cancelled.
+   * @param onLine called on the reader thread with every line of output, as it arrives.
+   */
+  static Result run(std::string command, const juce::File& cancelFlag, int gracePeriodMs,
+                    std::function<void(const juce::String&)> onLine = nullptr) {
+    // the helper writes its pid here, which is what lets us find the processes it started
+    auto pidFile = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                       .getChildFile("harp_helper_" + juce::Uuid().toString() + ".pid");
+    command += " --pid_path " + pidFile.getFullPathName().toStdString();
+
+    Result result;
+    auto state = std::make_shared<State>();
+    if (!state->process.start(command)) {
+      result.output = "Error: failed to start the helper: " + juce::String(command);
+      result.exitCode = 1;
+      return result;
+    }
+
+    // reads until the helper (and everything holding on to its output) is gone
+    std::thread reader([state, onLine] {
+      // onLine belongs to the caller of run(), so it is never called once run() has returned
+      auto emit = [&state, &onLine] (const juce::String& text) {
+        std::lock_guard<std::mutex> lock(state->lineMutex);
+        if (onLine && !state->abandoned) {
+          onLine(text);
+        }
+      };
+
+      auto endLine = [&state, &emit] (juce::MemoryOutputStream& line) {
+        auto text = line.toString().trimEnd();
+        line.reset();
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->tail.push_back(text);
+          if (state->tail.size() > maxTailLines) {
+            state->tail.pop_front();
+          }
+        }
+        emit(text);
+      };
+
+      // stdio buffers the pipe, so reading a byte at a time is cheap
+      char c;
+      juce::MemoryOutputStream line;
+      while (state->process.readProcessOutput(&c, 1) > 0) {
+        if (c == '\n') {
+          endLine(line);
+        } else {
+          line.writeByte(c);
+        }
+      }
+      if (line.getDataSize() > 0) {
+        endLine(line);
+      }
+      state->outputClosed.signal();
+    });
+
+    const double startedAt = juce::Time::getMillisecondCounterHiRes();
+    double cancelledAt = -1;
+    // counts from when cancel was pressed rather than from when we noticed
+    // (but not from before the helper started)
+    auto checkCancelled = [&] {
+      if (cancelledAt < 0 && cancelFlag != juce::File() && cancelFlag.exists()) {
+        auto now = juce::Time::getMillisecondCounterHiRes();
+        auto age = (double) (juce::Time::getCurrentTime() - cancelFlag.getLastModificationTime()).inMilliseconds();
+        cancelledAt = juce::jlimit(startedAt, now, now - age);
+      }
+    };
+
+    while (state->process.isRunning()) {
+      checkCancelled();
+
+      if (cancelledAt >= 0 && juce::Time::getMillisecondCounterHiRes() - cancelledAt > gracePeriodMs) {
+        killTree(pidFile);
+        state->process.kill();
+        result.killed = true;
+        break;
+      }
+
+      if (state->outputClosed.wait(pollIntervalMs)) {
+        // the output is closed and the helper is about to exit, so wait for that instead.
+        // (the event stays signalled, waiting on it again would return right away)
+        state->process.waitForProcessToFinish(pollIntervalMs);
+      }
+    }
+
+    // the helper may have seen the flag and exited before we did
+    checkCancelled();
+    if (cancelledAt >= 0) {
+      result.cancelLatencyMs = juce::Time::getMillisecondCounterHiRes() - cancelledAt;
+    }
+
+    // a process the helper started may still be holding its output open. it is
+    // not worth waiting for, the reader will finish on its own once it's gone.
+    if (state->outputClosed.wait(result.killed ? pollIntervalMs : 1000)) {
+      reader.join();
+    } else {
+      std::lock_guard<std::mutex> lock(state->lineMutex);
+      state->abandoned = true;
+      reader.detach();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      juce::StringArray lines;
+      for (const auto& line : state->tail) {
+        lines.add(line);
+      }
+      result.output = lines.joinIntoString("\n");
+    }
+    result.exitCode = result.killed ? 1 : state->process.getExitCode();
+    pidFile.deleteFile();
+    return result;
+  }
+
+private:
+  static constexpr int pollIntervalMs = 20;
+  static constexpr size_t maxTailLines = 200;
+
+  // shared with the reader thread, which may outlive run()
+  struct State {
+    juce::ChildProcess process;
+    std::mutex mutex;
+    std::deque<juce::String> tail;
+    juce::WaitableEvent outputClosed {true};
+    std::mutex lineMutex;
+    bool abandoned {false};
+  };
+
+  static void killTree(const juce::File& pidFile) {
+    auto pid = pidFile.loadFileAsString().trim().getIntValue();
+    if (pid <= 0) {
+      return;
+    }
+   #if JUCE_WINDOWS
+    juce::ChildProcess taskkill;
+    if (taskkill.start("taskkill /T /F /PID " + juce::String(pid), 0)) {
+      taskkill.waitForProcessToFinish(2000);
+    }
+   #else
+    // the helper puts itself in its own process group, so this takes out
+    // everything it started without touching HARP
+    ::kill(-(pid_t) pid, SIGKILL);
+   #endif
+  }
+};
@@ -0,0 +1,208 @@
+/**
+ * @file
+ * @brief Live preview: whenever a control changes, a short region of the
+ * working copy is sent to the model after a debounce, so the effect of a
+ * tweak can be heard without processing the whole file. Only the newest
+ * preview matters, so anything older is cancelled as soon as it goes stale.
+ */
+
+#pragma once
+
+#include "juce_events/juce_events.h"
+
+#include "Wave2Wave.h"
+#include "AudioUtils.h"
+#include "Settings.h"
+
+class LivePreview : private juce::Timer {
+public:
+  LivePreview() = default;
+
+  ~LivePreview() override {
+    stopTimer();
+    cancel();
+    // the helpers exit as soon as they see their cancel flags
+    if (m_pool != nullptr) {
+      m_pool->removeAllJobs(true, 10000);
+    }
+    m_regionFile.deleteFile();
+    m_lastPreview.deleteFile();
+  }
+
+  // called on the message thread with the newest finished preview
+  std::function<void(const juce::File&)> onPreviewReady;
+  // called on the message thread with short progress and error messages
+  std::function<void(const juce::String&)> onStatus;
+
+  void setModel(std::shared_ptr<Wave2Wave> model) {
+    cancel();
+    m_model = model;
+  }
+
+  // the preview covers previewSeconds of source, starting at startSeconds
+  void setSource(const juce::File& source, double startSeconds) {
+    cancel();
+    m_source = source;
+    m_startSeconds = startSeconds;
+    m_regionFile.deleteFile();
+    m_regionFile = juce::File();
+  }
+
+  // the source changed on disk (e.g. after processing), so the region needs to be cut again
+  void sourceChanged() { setSource(m_source, m_startSeconds); }
+
+  void setEnabled(bool enabled) {
+    m_enabled = enabled;
+    if (!enabled) {
+      cancel();
+    }
+  }
+
+  bool isEnabled() const { return m_enabled; }
+
+  // restarts the debounce. the preview is sent once the controls have been still for a moment.
+  void parametersChanged() {
+    if (!m_enabled || m_model == nullptr || !m_model->ready() || !m_source.existsAsFile()) {
+      return;
+    }
+    diagnostics::IdleMonitor::get().setActive("live preview", true);
+    startTimer(juce::jmax(0, HARPSettings::getInt(settingkeys::previewDebounceMs)));
+  }
+
+  // drops the pending preview and stops the one in flight, if any
+  void cancel() {
+    stopTimer();
+    diagnostics::IdleMonitor::get().setActive("live preview", false);
+    ++m_generation;
+    if (m_inFlight.cancel != juce::File()) {
+      m_inFlight.cancel.create();
+      m_inFlight = {};
+    }
+  }
+
+private:
+  void timerCallback() override {
+    diagnostics::IdleMonitor::get().wakeup("live preview");
+    stopTimer();
+    submit();
+  }
+
+  void submit() {
+    // whatever is still running was made with stale controls
+    cancel();
+    const auto generation = m_generation.load();
+
+    if (!m_regionFile.existsAsFile() && !cutRegion()) {
+      if (onStatus) {
+        onStatus("Live preview: failed to read the preview region");
+      }
+      return;
+    }
+
+    auto output = m_regionFile.getSiblingFile("harp_preview_" + juce::Uuid().toString() + ".wav");
+    m_regionFile.copyFileTo(output);
+    auto flags = JobFlags::makeUnique();
+    m_inFlight = flags;
+
+    // snapshot the controls now, the UI may change them again while the job runs
+    auto ctrls = m_model->controls();
+    auto model = m_model;
+    juce::WeakReference<LivePreview> weakThis(this);
+
+    if (onStatus) {
+      onStatus("Live preview: processing...");
+    }
+
+    if (m_pool == nullptr) {
+      m_pool = std::make_unique<juce::ThreadPool>(2);
+    }
+    auto running = m_running;
+    ++*running;
+    m_pool->addJob([weakThis, model, ctrls, flags, output, generation, running] {
+      juce::String error;
+      if (!flags.cancel.exists()) {
+        try {
+          model->process(output, *ctrls, flags);
+        } catch (const std::runtime_error& e) {
+          error = e.what();
+        }
+      }
+      const bool cancelled = flags.cancel.exists();
+      flags.cleanup();
+      --*running;
+
+      juce::MessageManager::callAsync([weakThis, flags, output, generation, cancelled, error] {
+        // a cancel that came in after the job was done may have left a flag behind
+        flags.cleanup();
+        auto* self = weakThis.get();
+        if (self != nullptr && self->m_inFlight.cancel == flags.cancel) {
+          self->m_inFlight = {};
+        }
+        if (self != nullptr) {
+          self->releasePoolIfIdle();
+        }
+        if (self == nullptr || cancelled || generation != self->m_generation) {
+          output.deleteFile();
+          return;
+        }
+        if (error.isNotEmpty()) {
+          output.deleteFile();
+          if (self->onStatus) {
+            self->onStatus("Live preview failed: " + error);
+          }
+          return;
+        }
+
+        auto previous = self->m_lastPreview;
+        self->m_lastPreview = output;
+        if (self->onPreviewReady) {
+          self->onPreviewReady(output);
+        }
+        // the player has moved on to the new preview by now
+        previous.deleteFile();
+      });
+    });
+  }
+
+  // idle workers still wake up every half second, so the pool is dropped between previews
+  void releasePoolIfIdle() {
+    if (m_pool != nullptr && *m_running == 0) {
+      m_pool.reset();
+    }
+  }
+
+  bool cutRegion() {
+    juce::AudioBuffer<float> region;
+    double sampleRate = 0;
+    if (!audioutils::readRange(m_source, region, sampleRate, m_startSeconds,
+                               HARPSettings::getDouble(settingkeys::previewSeconds))
+        || region.getNumSamples() == 0) {
+      return false;
+    }
+    m_regionFile = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                       .getChildFile("harp_preview_input_" + juce::Uuid().toString() + ".wav");
+    return audioutils::writeWav(m_regionFile, region, sampleRate);
+  }
+
+  std::shared_ptr<Wave2Wave> m_model;
+  juce::File m_source;
+  double m_startSeconds {0};
+  bool m_enabled {false};
+
+  // the region of the source that gets previewed, cut once per source
+  juce::File m_regionFile;
+  // the preview that is currently being played, deleted once a newer one arrives
+  juce::File m_lastPreview;
+
+  // bumped whenever a preview goes stale, so results from older jobs are dropped
+  std::atomic<int> m_generation {0};
+  JobFlags m_inFlight;
+
+  // two threads, so a new preview can start while the stale one is shutting down.
+  // only created once live preview is actually used.
+  std::unique_ptr<juce::ThreadPool> m_pool;
+  // jobs that haven't finished processing yet
+  std::shared_ptr<std::atomic<int>> m_running {std::make_shared<std::atomic<int>>(0)};
+
+  JUCE_DECLARE_WEAK_REFERENCEABLE(LivePreview)
+};
@@ -1,4 +1,5 @@
 #include "MainComponent.h"
+#include "Diagnostics.h"
 
 
 //==============================================================================
@@ -13,13 +14,15 @@ public:
     // you could `#include <JuceHeader.h>` and use `ProjectInfo::projectName` etc. instead.
     const juce::String getApplicationName() override       { return JUCE_APPLICATION_NAME_STRING; }
     const juce::String getApplicationVersion() override    { return JUCE_APPLICATION_VERSION_STRING; }
-    bool moreThanOneInstanceAllowed() override             { return true; }
+    bool moreThanOneInstanceAllowed() override             { return !HARPSettings::getBool(settingkeys::singleInstance); }
 
     bool debugFilesOn()                                    { return false; }
 
     //==============================================================================
     void initialise (const juce::String& commandLine) override
     {
+        diagnostics::StartupTimer::get().mark("initialise");
+
         // save the command line arguments to a debug file in my home directory
         if (debugFilesOn()) {
             File debugFile(juce::File::getSpecialLocation(juce::File::userHomeDirectory).getFullPathName() + "/debug.txt");
@@ -29,8 +32,12 @@ public:
         }
         
         mainWindow.reset(new MainWindow(getApplicationName()));
+        diagnostics::StartupTimer::get().mark("window");
         resetWindow(commandLine);
 
+        // this runs once the message loop is up and the window can take input
+        MessageManager::callAsync([] { diagnostics::StartupTimer::get().interactive(); });
+
     }
 
     void shutdown() override
@@ -72,8 +79,16 @@ public:
             debugFile.appendText(juce::File::getSpecialLocation(juce::File::userHomeDirectory).getFullPathName() + "\n", true, true);
         }
 
-        resetWindow(commandLine);
-        
+        // the file is handed over to this window, so the model it has loaded
+        // (and its helper) is reused instead of starting a fresh HARP
+        File audioFile(commandLine.unquoted().trim());
+        if (audioFile.existsAsFile()) {
+            if (auto* mainComp = dynamic_cast<MainComponent*>(mainWindow->getContentComponent())) {
+                mainComp->openHandedOverFile(URL(audioFile));
+            }
+        }
+        mainWindow->setMinimised(false);
+        mainWindow->toFront(true);
     }
 
     //==============================================================================
@@ -12,39 +12,29 @@
 #include <juce_gui_basics/juce_gui_basics.h>
 #include <juce_gui_extra/juce_gui_extra.h>
 
-#include "WebModel.h"
+#include "ModelFactory.h"
 #include "CtrlComponent.h"
 #include "TitledTextBox.h"
 #include "ThreadPoolJob.h"
+#include "VersionHistory.h"
+#include "Pipeline.h"
+#include "LivePreview.h"
+#include "RegionProcessor.h"
+#include "Sweep.h"
+#include "ChunkedProcessor.h"
+#include "SilenceTrimmer.h"
+#include "Diagnostics.h"
+#include "ControlServer.h"
 
 #include "gui/MultiButton.h"
 #include "gui/StatusComponent.h"
 #include "gui/HoverHandler.h"
+#include "gui/ResultsComponent.h"
+#include "gui/SweepComponent.h"
 
 using namespace juce;
 
 
-// this only calls the callback ONCE
-class TimedCallback : public Timer
-{
-public:
-    TimedCallback(std::function<void()> callback, int interval) : mCallback(callback), mInterval(interval) {
-        startTimer(mInterval);
-    }
-
-    ~TimedCallback() override {
-        stopTimer();
-    }
-
-    void timerCallback() override {
-        mCallback();
-        stopTimer();
-    }
-private:
-    std::function<void()> mCallback;
-    int mInterval;
-};
-
 inline Colour getUIColourIfAvailable (LookAndFeel_V4::ColourScheme::UIColour uiColour, Colour fallback = Colour (0xff4d4d4d)) noexcept
 {
     if (auto* v4 = dynamic_cast<LookAndFeel_V4*> (&LookAndFeel::getDefaultLookAndFeel()))
@@ -94,7 +84,8 @@ public:
     enum ActionType {
         FileDropped,
         TransportMoved,
-        TransportStarted
+        TransportStarted,
+        SelectionChanged
     };
     
 
@@ -106,6 +97,8 @@ public:
           thumbnail (512, formatManager, thumbnailCache)
     {
         thumbnail.addChangeListener (this);
+        // the cursor only needs a timer while the transport is playing
+        transportSource.addChangeListener (this);
 
         addAndMakeVisible (scrollbar);
         scrollbar.setRangeLimits (visibleRange);
@@ -120,26 +113,41 @@ public:
     {
         scrollbar.removeListener (this);
         thumbnail.removeChangeListener (this);
+        transportSource.removeChangeListener (this);
+        stopFollowingTransport();
     }
 
     void setURL (const URL& url)
     {
         if (auto inputSource = makeInputSource (url))
         {
+            currentURL = url;
+
             thumbnailCache.clear();
             thumbnail.setSource (inputSource.release());
 
             Range<double> newRange (0.0, thumbnail.getTotalLength());
             scrollbar.setRangeLimits (newRange);
             setRange (newRange);
-
-            startTimerHz (40);
         }
     }
 
     URL getLastDroppedFile() const noexcept { return lastFileDropped; }
     ActionType getLastActionType() const noexcept { return lastActionType; }
 
+    // the range (in seconds) that was shift-dragged over on url, empty if there is none.
+    // the selection stays with its file, so auditioning something else doesn't lose it.
+    Range<double> getSelection (const URL& url) const noexcept
+    {
+        return url == selectionURL ? selection : Range<double>();
+    }
+
+    void clearSelection()
+    {
+        selection = {};
+        repaint();
+    }
+
     void setZoomFactor (double amount)
     {
         if (thumbnail.getTotalLength() > 0)
@@ -176,6 +184,18 @@ public:
             thumbArea.removeFromBottom (scrollbar.getHeight() + 4);
             thumbnail.drawChannels (g, thumbArea.reduced (2),
                                     visibleRange.getStart(), visibleRange.getEnd(), 1.0f);
+
+            if (! selection.isEmpty() && selectionURL == currentURL)
+            {
+                auto x1 = jmax (0.0f, timeToX (selection.getStart()));
+                auto x2 = jmin ((float) getWidth(), timeToX (selection.getEnd()));
+                auto area = thumbArea.toFloat().withX (x1).withRight (x2);
+                g.setColour (Colours::white.withAlpha (0.2f));
+                g.fillRect (area);
+                g.setColour (Colours::white.withAlpha (0.6f));
+                g.drawVerticalLine ((int) x1, area.getY(), area.getBottom());
+                g.drawVerticalLine ((int) x2, area.getY(), area.getBottom());
+            }
         }
         else
         {
@@ -189,8 +209,18 @@ public:
         scrollbar.setBounds (getLocalBounds().removeFromBottom (14).reduced (2));
     }
 
-    void changeListenerCallback (ChangeBroadcaster*) override
+    void changeListenerCallback (ChangeBroadcaster* source) override
     {
+        if (source == &transportSource)
+        {
+            // started or stopped (which includes reaching the end of the file)
+            if (transportSource.isPlaying())
+                followTransport();
+            else
+                stopFollowingTransport();
+            return;
+        }
+
         // this method is called by the thumbnail when it has changed, so we should repaint it..
         repaint();
     }
@@ -209,14 +239,41 @@ public:
 
     void mouseDown (const MouseEvent& e) override
     {
+        // shift + drag selects a range, a plain click drops the selection
+        if (e.mods.isShiftDown())
+        {
+            selectionAnchor = clampTime (xToTime ((float) e.x));
+            selection = { selectionAnchor, selectionAnchor };
+            selectionURL = currentURL;
+            lastActionType = SelectionChanged;
+            repaint();
+            return;
+        }
+
+        if (! selection.isEmpty() && selectionURL == currentURL)
+        {
+            selection = {};
+            lastActionType = SelectionChanged;
+            sendChangeMessage();
+            repaint();
+        }
         mouseDrag (e);
     }
 
     void mouseDrag (const MouseEvent& e) override
     {
+        if (lastActionType == SelectionChanged && e.mods.isShiftDown())
+        {
+            auto time = clampTime (xToTime ((float) e.x));
+            selection = { jmin (selectionAnchor, time), jmax (selectionAnchor, time) };
+            repaint();
+            return;
+        }
+
         if (canMoveTransport())
             transportSource.setPosition (jmax (0.0, xToTime ((float) e.x)));
             lastActionType = TransportMoved;
+        updateCursorPosition();
     }
 
     void mouseUp (const MouseEvent&) override
@@ -226,6 +283,9 @@ public:
             lastActionType = TransportStarted;
             sendChangeMessage();
         }
+        else if (lastActionType == SelectionChanged) {
+            sendChangeMessage();
+        }
         
     }
 
@@ -264,6 +324,10 @@ private:
     bool isFollowingTransport = true;
     URL lastFileDropped;
     ActionType lastActionType;
+    URL currentURL;
+    URL selectionURL;
+    Range<double> selection;
+    double selectionAnchor = 0.0;
 
     DrawableRectangle currentPositionMarker;
 
@@ -280,6 +344,11 @@ private:
         return (x / (float) getWidth()) * (visibleRange.getLength()) + visibleRange.getStart();
     }
 
+    double clampTime (const double time) const
+    {
+        return jlimit (0.0, thumbnail.getTotalLength(), time);
+    }
+
     bool canMoveTransport() const noexcept
     {
         return ! (isFollowingTransport && transportSource.isPlaying());
@@ -292,8 +361,25 @@ private:
                 setRange (visibleRange.movedToStartAt (newRangeStart));
     }
 
+    void followTransport()
+    {
+        if (! isTimerRunning())
+        {
+            diagnostics::IdleMonitor::get().setActive ("waveform cursor", true);
+            startTimerHz (40);
+        }
+    }
+
+    void stopFollowingTransport()
+    {
+        stopTimer();
+        diagnostics::IdleMonitor::get().setActive ("waveform cursor", false);
+        updateCursorPosition();
+    }
+
     void timerCallback() override
     {
+        diagnostics::IdleMonitor::get().wakeup ("waveform cursor");
         if (canMoveTransport())
             updateCursorPosition();
         else
@@ -343,12 +429,23 @@ public:
         save = 0x2001,
         saveAs = 0x2002,
         about = 0x2003,
-        // settings = 0x2004,
+        settings = 0x2004,
+        undo = 0x2005,
+        redo = 0x2006,
+        addToPipeline = 0x2007,
+        processPipeline = 0x2008,
+        clearPipeline = 0x2009,
+        chunkPipeline = 0x200A,
+        addToComparison = 0x200B,
+        compareModels = 0x200C,
+        clearComparison = 0x200D,
+        livePreview = 0x200E,
+        parameterSweep = 0x200F,
     };
 
     StringArray getMenuBarNames() override
     {
-        return {"File"};
+        return {"File", "Edit", "Pipeline", "Compare"};
     }
 
     // In mac, we want the "about" command to be in the application menu ("HARP" tab)
@@ -369,10 +466,33 @@ public:
             menu.addCommandItem (&commandManager, CommandIDs::save);
             menu.addCommandItem (&commandManager, CommandIDs::saveAs);
             menu.addSeparator();
-            // menu.addCommandItem (&commandManager, CommandIDs::settings);
-            // menu.addSeparator();
+            menu.addCommandItem (&commandManager, CommandIDs::settings);
+            menu.addSeparator();
             menu.addCommandItem (&commandManager, CommandIDs::about);
-        } 
+        }
+        else if (menuName == "Edit")
+        {
+            menu.addCommandItem (&commandManager, CommandIDs::undo);
+            menu.addCommandItem (&commandManager, CommandIDs::redo);
+            menu.addSeparator();
+            menu.addCommandItem (&commandManager, CommandIDs::livePreview);
+        }
+        else if (menuName == "Pipeline")
+        {
+            menu.addCommandItem (&commandManager, CommandIDs::addToPipeline);
+            menu.addCommandItem (&commandManager, CommandIDs::processPipeline);
+            menu.addCommandItem (&commandManager, CommandIDs::clearPipeline);
+            menu.addSeparator();
+            menu.addCommandItem (&commandManager, CommandIDs::chunkPipeline);
+        }
+        else if (menuName == "Compare")
+        {
+            menu.addCommandItem (&commandManager, CommandIDs::addToComparison);
+            menu.addCommandItem (&commandManager, CommandIDs::compareModels);
+            menu.addCommandItem (&commandManager, CommandIDs::clearComparison);
+            menu.addSeparator();
+            menu.addCommandItem (&commandManager, CommandIDs::parameterSweep);
+        }
         return menu;
     }
     void menuItemSelected (int menuItemID, int topLevelMenuIndex) override {
@@ -391,6 +511,18 @@ public:
             CommandIDs::save, 
             CommandIDs::saveAs,
             CommandIDs::about,
+            CommandIDs::settings,
+            CommandIDs::undo,
+            CommandIDs::redo,
+            CommandIDs::addToPipeline,
+            CommandIDs::processPipeline,
+            CommandIDs::clearPipeline,
+            CommandIDs::chunkPipeline,
+            CommandIDs::addToComparison,
+            CommandIDs::compareModels,
+            CommandIDs::clearComparison,
+            CommandIDs::livePreview,
+            CommandIDs::parameterSweep,
             };
         commands.addArray(ids, numElementsInArray(ids));
     }
@@ -415,6 +547,56 @@ public:
             case CommandIDs::about:
                 result.setInfo("About HARP", "Shows information about the application", "About", 0);
                 break;
+            case CommandIDs::settings:
+                result.setInfo("Open Settings File", "Shows the settings file. Edits apply to the next job (singleInstance and controlPort after a restart)", "File", 0);
+                break;
+            case CommandIDs::undo:
+                result.setInfo("Undo", "Restores the previous processing result", "Edit", 0);
+                result.addDefaultKeypress('z', ModifierKeys::commandModifier);
+                result.setActive(history.canUndo() && !isProcessing);
+                break;
+            case CommandIDs::redo:
+                result.setInfo("Redo", "Restores the next processing result", "Edit", 0);
+                result.addDefaultKeypress('z', ModifierKeys::shiftModifier | ModifierKeys::commandModifier);
+                result.setActive(history.canRedo() && !isProcessing);
+                break;
+            case CommandIDs::addToPipeline:
+                result.setInfo("Add Model to Pipeline", "Appends the loaded model and its current controls to the pipeline", "Pipeline", 0);
+                result.setActive(model->ready() && !isProcessing);
+                break;
+            case CommandIDs::processPipeline:
+                result.setInfo("Process Pipeline", "Runs the audio file through every model in the pipeline", "Pipeline", 0);
+                result.setActive(!pipeline.empty() && audioFileIsLoaded && !isProcessing);
+                break;
+            case CommandIDs::clearPipeline:
+                result.setInfo("Clear Pipeline", "Removes all models from the pipeline", "Pipeline", 0);
+                result.setActive(!pipeline.empty() && !isProcessing);
+                break;
+            case CommandIDs::chunkPipeline:
+                result.setInfo("Process in Chunks", "Streams the audio through the pipeline in chunks, so all models work at the same time", "Pipeline", 0);
+                result.setTicked(pipelineChunked);
+                break;
+            case CommandIDs::addToComparison:
+                result.setInfo("Add Model to Comparison", "Adds the loaded model and its current controls to the comparison", "Compare", 0);
+                result.setActive(model->ready() && !isProcessing);
+                break;
+            case CommandIDs::compareModels:
+                result.setInfo("Compare Models", "Runs the audio file through every model in the comparison at the same time", "Compare", 0);
+                result.setActive(!comparison.empty() && audioFileIsLoaded && !isProcessing);
+                break;
+            case CommandIDs::clearComparison:
+                result.setInfo("Clear Comparison", "Removes all models from the comparison", "Compare", 0);
+                result.setActive(!comparison.empty() && !isProcessing);
+                break;
+            case CommandIDs::livePreview:
+                result.setInfo("Live Preview", "Processes and plays a short preview whenever a control changes", "Edit", 0);
+                result.addDefaultKeypress('l', ModifierKeys::commandModifier);
+                result.setTicked(livePreview.isEnabled());
+                break;
+            case CommandIDs::parameterSweep:
+                result.setInfo("Parameter Sweep...", "Runs the audio file through the loaded model with every combination of the chosen control values", "Compare", 0);
+                result.setActive(model->ready() && audioFileIsLoaded && !isProcessing);
+                break;
         }
     }
 
@@ -439,6 +621,65 @@ public:
                 // URL("https://harp-plugin.netlify.app/").launchInDefaultBrowser();
                 // URL("https://github.com/TEAMuP-dev/harp").launchInDefaultBrowser();
                 break;
+            case CommandIDs::settings:
+                DBG("Settings command invoked");
+                // edits to the file are picked up within a second, and set() merges them before saving
+                HARPSettings::writeDefaults().revealToUser();
+                break;
+            case CommandIDs::undo:
+                DBG("Undo command invoked");
+                undoCallback();
+                break;
+            case CommandIDs::redo:
+                DBG("Redo command invoked");
+                redoCallback();
+                break;
+            case CommandIDs::addToPipeline:
+                DBG("Add to pipeline command invoked");
+                pipeline.addStage(model);
+                setStatus("Pipeline: " + pipeline.getDescription());
+                commandManager.commandStatusChanged();
+                break;
+            case CommandIDs::processPipeline:
+                DBG("Process pipeline command invoked");
+                processPipelineCallback();
+                break;
+            case CommandIDs::clearPipeline:
+                DBG("Clear pipeline command invoked");
+                pipeline.clear();
+                setStatus("Pipeline cleared");
+                commandManager.commandStatusChanged();
+                break;
+            case CommandIDs::chunkPipeline:
+                pipelineChunked = !pipelineChunked;
+                commandManager.commandStatusChanged();
+                break;
+            case CommandIDs::addToComparison:
+                DBG("Add to comparison command invoked");
+                comparison.push_back({model, model->controls()});
+                setStatus(String((int) comparison.size()) + " models to compare");
+                commandManager.commandStatusChanged();
+                break;
+            case CommandIDs::compareModels:
+                DBG("Compare models command invoked");
+                compareCallback();
+                break;
+            case CommandIDs::clearComparison:
+                DBG("Clear comparison command invoked");
+                comparison.clear();
+                setStatus("Comparison cleared");
+                commandManager.commandStatusChanged();
+                break;
+            case CommandIDs::livePreview:
+                livePreview.setEnabled(!livePreview.isEnabled());
+                HARPSettings::set(settingkeys::livePreview, livePreview.isEnabled());
+                setStatus(livePreview.isEnabled() ? "Live preview on" : "Live preview off");
+                commandManager.commandStatusChanged();
+                break;
+            case CommandIDs::parameterSweep:
+                DBG("Parameter sweep command invoked");
+                showSweepDialog();
+                break;
             default:
                 return false;
         }
@@ -512,7 +753,11 @@ public:
     void saveCallback(){
         if (saveEnabled) {
             DBG("HARPProcessorEditor::buttonClicked save button listener activated");
-            // copy the file to the target location
+            // copy the file to the target location.
+            // a working copy that became a wav still goes back to the original file, so whoever
+            // handed it over sees the result, but it holds wav audio from now on
+            auto workingExtension = currentAudioFile.getLocalFile().getFileExtension();
+            const bool formatChanged = ! currentAudioFileTarget.getLocalFile().hasFileExtension(workingExtension);
             DBG("copying from " << currentAudioFile.getLocalFile().getFullPathName() << " to " << currentAudioFileTarget.getLocalFile().getFullPathName());
             // make a backup for the undo button
             // rename the original file to have a _backup suffix
@@ -537,14 +782,77 @@ public:
             addNewAudioFile(currentAudioFileTarget);
             // saveButton.setEnabled(false);
             saveEnabled = false;
-            setStatus("File saved successfully");
+            if (formatChanged) {
+                auto formatName = workingExtension.trimCharactersAtStart(".").toUpperCase();
+                setStatus("File saved as " + formatName + " audio");
+                AlertWindow::showMessageBoxAsync(
+                    AlertWindow::InfoIcon,
+                    "Format changed",
+                    "HARP can't write " + currentAudioFileTarget.getLocalFile().getFileExtension()
+                    + " files, so " + currentAudioFileTarget.getLocalFile().getFileName()
+                    + " now holds " + formatName + " audio. Most editors read it by its contents, "
+                    "but you may want to export it again in its original format."
+                );
+            } else {
+                setStatus("File saved successfully");
+            }
         } else {
             DBG("save button is disabled");
             setStatus("Nothing to save");
         }
     }
 
-    
+    void undoCallback() {
+        // the latest result may still be on its way into the history
+        history.waitForCommits();
+        restoreVersion(history.getCurrentIndex() - 1);
+    }
+
+    void redoCallback() {
+        history.waitForCommits();
+        restoreVersion(history.getCurrentIndex() + 1);
+    }
+
+    // adds the working copy to the history in the background, the menu catches up once it's in
+    void commitToHistory(const String& label) {
+        history.commit(currentAudioFile.getLocalFile(), label, [this, label] (bool ok) {
+            if (!ok) {
+                DBG("MainComponent::commitToHistory: failed to keep " << label << " in the history");
+            }
+            commandManager.commandStatusChanged();
+        });
+    }
+
+    // replaces the working copy with a version from the history
+    void restoreVersion(int index) {
+        if (isProcessing) {
+            setStatus("Can't undo/redo while processing");
+            return;
+        }
+        if (index < 0 || index >= history.getNumVersions()) {
+            setStatus("Nothing to " + String(index < history.getCurrentIndex() ? "undo" : "redo"));
+            return;
+        }
+
+        // release the working copy before we overwrite it
+        stop();
+        transportSource.setSource (nullptr);
+        currentAudioFileSource.reset();
+
+        if (history.restore(index, currentAudioFile.getLocalFile())) {
+            setStatus("Restored version " + String(index + 1) + "/" + String(history.getNumVersions())
+                      + " (" + history.getLabel(index) + ")");
+            // the original file doesn't need saving, everything else does
+            saveEnabled = index > 0;
+        } else {
+            setStatus("Failed to restore version " + String(index + 1));
+        }
+
+        livePreview.sourceChanged();
+        showAudioResource(currentAudioFile);
+        commandManager.commandStatusChanged();
+    }
+
     void saveAsCallback() {
         if (audioFileIsLoaded) {
             // Launch the file chooser dialog asynchronously
@@ -605,36 +913,31 @@ public:
         {"url", path_url},
         };
         resetUI();
+
+        // an upload for the old model is no use to the new one
+        if (auto* webModel = dynamic_cast<WebWave2Wave*>(model.get())) {
+            webModel->cancelPreupload();
+        }
+
+        // every load gets a fresh instance, so that models that were
+        // added to the pipeline stay loaded
+        model = models::create(path_url);
+        mModelStatusTimer->setModel(model);
+        isLoading = true;
+        watchModelStatus();
         // loading happens asynchronously.
         // the document controller trigger a change listener callback, which will update the UI
 
-        threadPool.addJob([this, params] {
+        if (threadPool == nullptr) {
+            threadPool = std::make_unique<ThreadPool>(1);
+        }
+        // the job keeps its own reference, picking another model meanwhile replaces model
+        threadPool->addJob([this, params, jobModel = model] {
             DBG("executeLoad!!");
             try {
-                // timeout after 10 seconds
-                // TODO: this callback needs to be cleaned up in the destructor in case we quit
-                // cb: this timedCallback doesn't seem to run
-                std::atomic<bool> success = false;
-                TimedCallback timedCallback([this, &success] {
-                    if (success)
-                        return;
-                    DBG("TIMED-CALLBACK: buttonClicked timedCallback listener activated");
-                    AlertWindow::showMessageBoxAsync(
-                        AlertWindow::WarningIcon,
-                        "Loading Error",
-                        "An error occurred while loading the WebModel: TIMED OUT! Please check that the space is awake."
-                    );
-                    MessageManager::callAsync([this] {
-                        resetModelPathComboBox();
-                    });
-                    model.reset(new WebWave2Wave());
-                    loadBroadcaster.sendChangeMessage();
-                    // saveButton.setEnabled(false);
-                    saveEnabled = false;
-                }, 10000);
-
-                model->load(params);
-                success = true;
+                // a space that doesn't answer in time makes load() throw,
+                // see the connect and queue time limits in the settings
+                jobModel->load(params);
                 MessageManager::callAsync([this] {
                     if (modelPathComboBox.getSelectedItemIndex() == 0) {
                         bool alreadyInComboBox = false;
@@ -667,11 +970,11 @@ public:
                     .withIconType(AlertWindow::WarningIcon)
                     .withTitle("Error")
                     .withMessage("An error occurred while loading the WebModel: \n" + String(e.what()));
-                if (!String(e.what()).contains("404")) {
+                if (!String(e.what()).contains("404") && !models::isBuiltin(std::any_cast<std::string>(params.at("url")))) {
                     msgOpts = msgOpts.withButton("Open Space URL");
                 }
                     msgOpts = msgOpts.withButton("Open HARP Logs").withButton("Ok");
-                auto alertCallback = [this, msgOpts](int result) {
+                auto alertCallback = [this, msgOpts, jobModel](int result) {
                     // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
                     // NOTE (hugo): there's something weird about the button indices assigned by the msgOpts here
                     // DBG("ALERT-CALLBACK: buttonClicked alertCallback listener activated: chosen: " << chosen);
@@ -691,10 +994,14 @@ public:
 
                     // auto chosen = msgOpts.getButtonText();
                     if (chosen == "Open HARP Logs") {
-                        model->getLogFile().revealToUser();
+                        jobModel->getLogFile().revealToUser();
                     } else if (chosen == "Open Space URL") {
-                        URL spaceUrl = resolveSpaceUrl(modelPathComboBox.getText().toStdString());
-                        bool success = spaceUrl.launchInDefaultBrowser();
+                        if (models::isLocal(modelPathComboBox.getText().toStdString())) {
+                            File(modelPathComboBox.getText()).revealToUser();
+                        } else {
+                            URL spaceUrl = resolveSpaceUrl(modelPathComboBox.getText().toStdString());
+                            bool success = spaceUrl.launchInDefaultBrowser();
+                        }
                     }
                     MessageManager::callAsync([this] {
                         resetModelPathComboBox();
@@ -704,10 +1011,15 @@ public:
                 
                 AlertWindow::showAsync(msgOpts,alertCallback);
 
-                model.reset(new WebWave2Wave());
-                loadBroadcaster.sendChangeMessage();
-                // saveButton.setEnabled(false);
-                saveEnabled = false;
+                MessageManager::callAsync([this, jobModel] {
+                    // a model picked while this one was loading stays
+                    if (model == jobModel) {
+                        model.reset(new WebWave2Wave());
+                    }
+                    loadBroadcaster.sendChangeMessage();
+                    // saveButton.setEnabled(false);
+                    saveEnabled = false;
+                });
                 
             }
         });
@@ -735,9 +1047,19 @@ public:
         // we might have to append a "https://huggingface.co/spaces" to the url
         // IF the url (doesn't have localhost) and (doesn't have huggingface.co) and (doesn't have http) in it 
         // and (has only one slash in it)
-        String spaceUrl = resolveSpaceUrl(url);
-        spaceUrlButton.setButtonText("open " + url + " in browser");
-        spaceUrlButton.setURL(URL(spaceUrl));
+        if (models::isBuiltin(path_url)) {
+            // nothing to open, it's part of HARP
+            spaceUrlButton.setButtonText("built into HARP, works offline");
+            spaceUrlButton.setURL(URL());
+        } else if (models::isLocal(path_url)) {
+            // a model on disk has no page, show its file instead
+            spaceUrlButton.setButtonText("show " + File(url).getFileName());
+            spaceUrlButton.setURL(URL(File(url).getParentDirectory()));
+        } else {
+            String spaceUrl = resolveSpaceUrl(url);
+            spaceUrlButton.setButtonText("open " + url + " in browser");
+            spaceUrlButton.setURL(URL(spaceUrl));
+        }
         // set the font size 
         // spaceUrlButton.setFont(Font(15.00f, Font::plain));
 
@@ -800,6 +1122,7 @@ public:
         thumbnailHandler->attach();
         addAndMakeVisible (thumbnail.get());
         thumbnail->addChangeListener (this);
+        transportSource.addChangeListener (this);
 
         // addAndMakeVisible (startStopButton);
         playStopButton.addMode(playButtonInfo);
@@ -818,13 +1141,8 @@ public:
         };
 
         // audio setup
+        // (the device and the read-ahead thread are started the first time they're needed)
         formatManager.registerBasicFormats();
-
-        thread.startThread (Thread::Priority::normal);
-
-        audioDeviceManager.initialise (0, 2, nullptr, true, {}, nullptr);
-
-        audioDeviceManager.addAudioCallback (&audioSourcePlayer);
         audioSourcePlayer.setSource (&transportSource);
 
 
@@ -899,6 +1217,25 @@ public:
 
         loadBroadcaster.addChangeListener(this);
 
+        results.onPlay = [this] (const File& file) { auditionFile(file); };
+        results.onUse = [this] (const File& file) { useResult(file); };
+        results.onShowWorkingCopy = [this] {
+            stop();
+            showAudioResource(currentAudioFile);
+        };
+        results.onExport = [this] { exportResults(); };
+
+        livePreview.setEnabled(HARPSettings::getBool(settingkeys::livePreview));
+        livePreview.setModel(model);
+        livePreview.onPreviewReady = [this] (const File& file) {
+            if (!isProcessing) {
+                auditionFile(file);
+                setStatus("Playing live preview");
+            }
+        };
+        livePreview.onStatus = [this] (const String& status) { setStatus(status); };
+        ctrlComponent.onCtrlChanged = [this] { livePreview.parametersChanged(); };
+
         std::string currentStatus = model->getStatus();
         if (currentStatus == "Status.LOADED" || currentStatus == "Status.FINISHED") {
             processCancelButton.setEnabled(true);
@@ -912,9 +1249,10 @@ public:
         setStatus(currentStatus);
 
         // add a status timer to update the status label periodically
+        // (it starts polling once a model has something to report, see watchModelStatus)
         mModelStatusTimer = std::make_unique<ModelStatusTimer>(model);
+        mModelStatusTimer->isBusy = [this] { return isProcessing || isLoading; };
         mModelStatusTimer->addChangeListener(this);
-        mModelStatusTimer->startTimer(100);  // 100 ms interval
 
        // model path textbox
        std::vector<std::string> modelPaths = {
@@ -933,6 +1271,10 @@ public:
         "hugggof/pitch_shifter",
         "hugggof/harmonic_percussive",
         };
+        // the built-in versions of the last two, which work offline
+        for (const auto& name : models::builtins()) {
+            modelPaths.push_back(name);
+        }
 
 
         modelPathComboBox.setTextWhenNothingSelected("choose a model"); 
@@ -997,14 +1339,18 @@ public:
         auto &card = model->card();
         setModelCard(card);
 
-        jobProcessorThread.startThread();
-
-        startTimerHz(10);
         // ARA requires that plugin editors are resizable to support tight integration
         // into the host UI
         setOpaque (true);
         setSize(800, 800);
         resized();
+
+        // scripts can drive HARP over localhost (off unless a port is set)
+        if (auto port = HARPSettings::getInt(settingkeys::controlPort); port > 0 && !controlServer.start(port)) {
+            setStatus("Control API: can't listen on port " + String(port));
+        }
+
+        diagnostics::StartupTimer::get().mark("main component");
     }
 
 
@@ -1016,6 +1362,7 @@ public:
         audioDeviceManager.removeAudioCallback (&audioSourcePlayer);
 
         thumbnail->removeChangeListener (this);
+        transportSource.removeChangeListener (this);
 
         // remove listeners
         mModelStatusTimer->removeChangeListener(this);
@@ -1029,28 +1376,36 @@ public:
         jobProcessorThread.signalTask();
         jobProcessorThread.waitForThreadToExit(-1);
 
+        // the history only lives as long as the session
+        history.clear();
+        // and so do the results of comparisons and sweeps
+        batchDir.deleteRecursively();
+
+        diagnostics::IdleMonitor::get().writeReport();
+
         #if JUCE_MAC
             MenuBarModel::setMacMainMenu (nullptr);
         #endif
         // commandManager.setFirstCommandTarget (nullptr);
     }
 
+    // fires once nothing has played for a while, see releaseAudioDeviceLater()
     void timerCallback() override
     {
-        if (!transportSource.isPlaying() && playStopButton.getModeName() == stopButtonInfo.label)
-        {
-            playStopButton.setMode(playButtonInfo.label);
-            stopTimer();
-            transportSource.setPosition (0.0);
-            
-        }
-        
+        diagnostics::IdleMonitor::get().wakeup("audio release");
+        stopTimer();
+        if (!transportSource.isPlaying())
+            closeAudioDevice();
     }
 
     void cancelCallback()
     {
         DBG("HARPProcessorEditor::buttonClicked cancel button listener activated");
         model->cancel();
+        pipeline.cancel();
+        for (auto& flags : batchFlags) {
+            flags.cancel.create();
+        }
         processCancelButton.setEnabled(false);
     }
     
@@ -1074,8 +1429,12 @@ public:
         processCancelButton.setEnabled(true);
         processCancelButton.setMode(cancelButtonInfo.label);
 
+        saveEnabledBeforeJob = saveEnabled;
+        processSucceeded = false;
         saveEnabled = false;
         isProcessing = true;
+        // the full result is on its way, the preview would only compete for the space
+        livePreview.cancel();
 
         // TODO: get the current audio file and process it
         // if we don't have one, let the user know
@@ -1088,25 +1447,348 @@ public:
         }
 
         // print how many jobs are currently in the threadpool
-        DBG("threadPool.getNumJobs: " << threadPool.getNumJobs());
+        DBG("threadPool.getNumJobs: " << (threadPool != nullptr ? threadPool->getNumJobs() : 0));
 
         // empty customJobs
         customJobs.clear();
 
+        // with a selection, only that part of the file is sent
+        auto selection = thumbnail->getSelection(currentAudioFile);
+        processLabel = String(model->card().name);
+        if (! selection.isEmpty()) {
+            processLabel += " (" + String(selection.getStart(), 2) + "s - " + String(selection.getEnd(), 2) + "s)";
+        }
+
         customJobs.push_back(new CustomThreadPoolJob(
-            [this] { // &jobsFinished, totalJobs
+            [this, jobModel = model, ctrls = model->controls(), selection,
+             file = currentAudioFile.getLocalFile(),
+             padding = HARPSettings::getDouble(settingkeys::regionPadding),
+             crossfade = HARPSettings::getDouble(settingkeys::regionCrossfade)] { // &jobsFinished, totalJobs
                 // Individual job code for each iteration
                 // copy the audio file, with the same filename except for an added _harp to the stem
-                model->process(currentAudioFile.getLocalFile());
+                try {
+                    // the working copy is about to change, the history has to be done reading it
+                    history.waitForCommits();
+                    bool processed = false;
+                    if (selection.isEmpty() && chunked::shouldProcessInChunks(file)) {
+                        // big files go up in pieces (if the settings ask for it). finished chunks are
+                        // kept, so pressing Process again after a failure resumes at the chunk that failed
+                        processed = chunked::processInChunks(*jobModel, *ctrls, jobModel->sharedJobFlags(), file,
+                                                 [this] (const String& progress) {
+                            MessageManager::callAsync([this, progress] { setStatus(progress); });
+                        });
+                    } else if (selection.isEmpty() && silence::isEnabled()) {
+                        // sparse stems only send the parts that have something in them
+                        processed = silence::processActive(*jobModel, *ctrls, file, [this] (const String& progress) {
+                            MessageManager::callAsync([this, progress] { setStatus(progress); });
+                        });
+                    } else if (selection.isEmpty()) {
+                        processed = jobModel->process(file, *ctrls);
+                    } else {
+                        auto result = processRegion(*jobModel, *ctrls, file, selection, padding, crossfade);
+                        processed = result != File();
+                        if (processed && result != file) {
+                            // a working copy that couldn't be rewritten as it was is a wav now
+                            MessageManager::callAsync([this, result, selection] {
+                                currentAudioFile = URL(result);
+                                livePreview.setSource(result, selection.getStart());
+                            });
+                        }
+                    }
+                    // only a finished job goes into the history, the job thread reports it once all jobs are done
+                    processSucceeded = processed;
+                } catch (const std::runtime_error& e) {
+                    showProcessingError(e.what());
+                }
                 DBG("Processing finished");
-                // load the audio file again
-                processBroadcaster.sendChangeMessage();
-                
             }
         ));
 
         // Now the customJobs are ready to be added to be run in the threadPool
-        jobProcessorThread.signalTask();
+        startJobs();
+    }
+
+    void processPipelineCallback()
+    {
+        if (!currentAudioFile.isLocalFile()) {
+            AlertWindow::showMessageBoxAsync(
+                AlertWindow::WarningIcon,
+                "Error",
+                "Audio file is not loaded. Please load an audio file first."
+            );
+            return;
+        }
+
+        processCancelButton.setEnabled(true);
+        processCancelButton.setMode(cancelButtonInfo.label);
+        saveEnabledBeforeJob = saveEnabled;
+        processSucceeded = false;
+        saveEnabled = false;
+        isProcessing = true;
+        commandManager.commandStatusChanged();
+
+        // 30s chunks are long enough for most models to have some context
+        pipeline.setChunking(pipelineChunked ? 30.0 : 0.0, 0.5);
+        processLabel = "pipeline: " + pipeline.getDescription();
+
+        customJobs.clear();
+        customJobs.push_back(new CustomThreadPoolJob(
+            [this, file = currentAudioFile.getLocalFile()] {
+                try {
+                    history.waitForCommits();
+                    processSucceeded = pipeline.process(file, [this] (const String& progress) {
+                        MessageManager::callAsync([this, progress] { setStatus(progress); });
+                    });
+                } catch (const std::runtime_error& e) {
+                    showProcessingError(e.what());
+                }
+                DBG("Pipeline finished");
+            }
+        ));
+        startJobs();
+    }
+
+    // sends the same input to every model in the comparison at once.
+    // each model has its own helper, so this takes about as long as the slowest model.
+    void compareCallback()
+    {
+        if (!currentAudioFile.isLocalFile()) {
+            AlertWindow::showMessageBoxAsync(
+                AlertWindow::WarningIcon,
+                "Error",
+                "Audio file is not loaded. Please load an audio file first."
+            );
+            return;
+        }
+
+        processCancelButton.setEnabled(true);
+        processCancelButton.setMode(cancelButtonInfo.label);
+        isProcessing = true;
+        currentBatch = BatchKind::Compare;
+        commandManager.commandStatusChanged();
+
+        results.clearResults();
+        results.setHeading("Comparing " + String((int) comparison.size()) + " models...");
+        showResultsWindow();
+
+        auto input = currentAudioFile.getLocalFile();
+        auto compareDir = newBatchDir("compare");
+        batchStartTime = Time::getMillisecondCounterHiRes();
+
+        customJobs.clear();
+        batchFlags.clear();
+        for (size_t i = 0; i < comparison.size(); ++i) {
+            auto entry = comparison[i];
+            String name = entry.model->card().name.empty() ? String(entry.model->space_url())
+                                                           : String(entry.model->card().name);
+            // the copy keeps the input's extension, since it holds the input's bytes until the model is done
+            auto output = compareDir.getChildFile(input.getFileNameWithoutExtension() + "_" + String((int) i + 1)
+                                                  + "_" + File::createLegalFileName(name) + input.getFileExtension());
+            input.copyFileTo(output);
+            // the same model can be in the comparison more than once, so every entry gets flags of its own
+            batchFlags.push_back(JobFlags::makeUnique());
+
+            customJobs.push_back(new CustomThreadPoolJob(
+                [this, entry, name, output, flags = batchFlags.back()] {
+                    auto start = Time::getMillisecondCounterHiRes();
+                    bool processed = false;
+                    try {
+                        processed = entry.model->process(output, *entry.ctrls, flags);
+                        auto seconds = (Time::getMillisecondCounterHiRes() - start) / 1000.0;
+                        if (processed) {
+                            MessageManager::callAsync([this, name, output, seconds] {
+                                results.addResult(name + " (" + String(seconds, 1) + " s)", output);
+                            });
+                        }
+                    } catch (const std::runtime_error& e) {
+                        showProcessingError(name + ": " + e.what());
+                    }
+                    if (!processed) {
+                        output.deleteFile();
+                    }
+                    flags.cleanup();
+                }
+            ));
+        }
+        startJobs();
+    }
+
+    void showSweepDialog()
+    {
+        auto* sweepComponent = new SweepComponent(model->controls());
+
+        DialogWindow::LaunchOptions options;
+        options.content.setOwned(sweepComponent);
+        options.dialogTitle = "Parameter Sweep";
+        options.escapeKeyTriggersCloseButton = true;
+        options.useNativeTitleBar = true;
+        options.resizable = true;
+        auto* dialog = options.launchAsync();
+
+        sweepComponent->onRun = [this, dialog] (std::vector<SweepAxis> axes) {
+            dialog->exitModalState(0);
+            sweepCallback(axes);
+        };
+    }
+
+    // runs every combination of the sweep through the loaded model at once.
+    // all jobs share one model, so each gets its own flag files to be cancelled with.
+    void sweepCallback(const std::vector<SweepAxis>& axes)
+    {
+        if (!currentAudioFile.isLocalFile()) {
+            AlertWindow::showMessageBoxAsync(
+                AlertWindow::WarningIcon,
+                "Error",
+                "Audio file is not loaded. Please load an audio file first."
+            );
+            return;
+        }
+
+        auto grid = sweep::makeGrid(model->controls(), axes);
+        if (grid.empty()) {
+            return;
+        }
+
+        processCancelButton.setEnabled(true);
+        processCancelButton.setMode(cancelButtonInfo.label);
+        isProcessing = true;
+        currentBatch = BatchKind::Sweep;
+        commandManager.commandStatusChanged();
+
+        results.clearResults();
+        results.setHeading("Sweeping " + String((int) grid.size()) + " combinations...");
+        showResultsWindow();
+
+        auto input = currentAudioFile.getLocalFile();
+        auto sweepDir = newBatchDir("sweep");
+        batchStartTime = Time::getMillisecondCounterHiRes();
+
+        customJobs.clear();
+        batchFlags.clear();
+        for (size_t i = 0; i < grid.size(); ++i) {
+            auto point = grid[i];
+            auto output = sweepDir.getChildFile(input.getFileNameWithoutExtension() + "_" + String((int) i + 1)
+                                                + "_" + File::createLegalFileName(point.label) + input.getFileExtension());
+            input.copyFileTo(output);
+            batchFlags.push_back(JobFlags::makeUnique());
+
+            customJobs.push_back(new CustomThreadPoolJob(
+                [this, jobModel = model, point, output, flags = batchFlags.back()] {
+                    bool processed = false;
+                    try {
+                        processed = jobModel->process(output, *point.ctrls, flags);
+                        if (processed) {
+                            MessageManager::callAsync([this, point, output] {
+                                results.addResult(point.label, output);
+                            });
+                        }
+                    } catch (const std::runtime_error& e) {
+                        showProcessingError(point.label + ": " + e.what());
+                    }
+                    if (!processed) {
+                        output.deleteFile();
+                    }
+                    flags.cleanup();
+                }
+            ));
+        }
+        startJobs();
+    }
+
+    // a fresh temporary folder for the results of a new batch. the results of the
+    // previous batch were just cleared from the list, so their folder goes too.
+    File newBatchDir(const String& kind)
+    {
+        batchDir.deleteRecursively();
+        batchDir = File::getSpecialLocation(File::tempDirectory)
+                       .getChildFile("harp_" + kind + "_" + Uuid().toString());
+        batchDir.createDirectory();
+        return batchDir;
+    }
+
+    // copies every result into a folder, named after its label
+    void exportResults()
+    {
+        auto toExport = results.getResults();
+        if (toExport.empty()) {
+            setStatus("Nothing to export");
+            return;
+        }
+
+        exportChooser = std::make_unique<FileChooser>("Export results to...", File(), "*");
+        exportChooser->launchAsync(
+            FileBrowserComponent::openMode | FileBrowserComponent::canSelectDirectories,
+            [this, toExport] (const FileChooser& chooser) {
+                auto dir = chooser.getResult();
+                if (dir == File()) {
+                    return;
+                }
+                int numExported = 0;
+                for (const auto& result : toExport) {
+                    auto target = dir.getNonexistentChildFile(File::createLegalFileName(result.first),
+                                                              result.second.getFileExtension(), false);
+                    if (result.second.copyFileTo(target)) {
+                        numExported++;
+                    }
+                }
+                setStatus("Exported " + String(numExported) + " results to " + dir.getFullPathName());
+            });
+    }
+
+    void showResultsWindow()
+    {
+        if (resultsWindow == nullptr) {
+            resultsWindow = std::make_unique<ResultsWindow>("HARP Results", results);
+            resultsWindow->centreWithSize(500, 300);
+        }
+        resultsWindow->setVisible(true);
+        resultsWindow->toFront(true);
+    }
+
+    // plays a result without touching the working copy
+    void auditionFile(const File& file)
+    {
+        stop();
+        showAudioResource(URL(file));
+        play();
+        setStatus("Playing " + file.getFileNameWithoutExtension());
+    }
+
+    // makes a result the new working copy
+    void useResult(const File& file)
+    {
+        if (isProcessing) {
+            setStatus("Can't change the working copy while processing");
+            return;
+        }
+        stop();
+        transportSource.setSource (nullptr);
+        currentAudioFileSource.reset();
+        history.waitForCommits();
+
+        if (file.copyFileTo(currentAudioFile.getLocalFile())) {
+            commitToHistory(file.getFileNameWithoutExtension());
+            saveEnabled = true;
+            setStatus("Using " + file.getFileNameWithoutExtension());
+        } else {
+            setStatus("Failed to use " + file.getFileNameWithoutExtension());
+        }
+        livePreview.sourceChanged();
+        showAudioResource(currentAudioFile);
+        commandManager.commandStatusChanged();
+    }
+
+    // can be called from any thread
+    void showProcessingError(const String& message)
+    {
+        DBG("Processing error: " << message);
+        MessageManager::callAsync([message] {
+            AlertWindow::showMessageBoxAsync(
+                AlertWindow::WarningIcon,
+                "Processing Error",
+                "An error occurred while processing: \n" + message
+            );
+        });
     }
     
 
@@ -1290,6 +1972,30 @@ public:
         addNewAudioFile(audioURL);
     }
 
+    // a file opened from another launch of HARP (e.g. a DAW's external editor).
+    // a running job keeps its file, so the new one waits until the job is done
+    void openHandedOverFile(const URL& audioURL) {
+        if (isProcessing) {
+            pendingHandoff = audioURL;
+            setStatus("Will open " + audioURL.getLocalFile().getFileName() + " when processing finishes");
+            return;
+        }
+        stop();
+        loadAudioFile(audioURL);
+        if (model->ready()) {
+            setStatus("Opened " + audioURL.getLocalFile().getFileName() + ", " + String(model->card().name) + " is still loaded");
+        }
+    }
+
+    void openPendingHandoff() {
+        if (pendingHandoff.isEmpty()) {
+            return;
+        }
+        auto audioURL = pendingHandoff;
+        pendingHandoff = URL();
+        openHandedOverFile(audioURL);
+    }
+
     void setStatus(const juce::String& message)
     {
         statusArea.setStatusMessage(message);
@@ -1352,6 +2058,9 @@ private:
     // A flag that indicates if the audio file can be saved
     bool saveEnabled = true;
     bool isProcessing = false;
+    // a file handed over by another launch while a job was running
+    URL pendingHandoff;
+    bool isLoading = false;
     bool audioFileIsLoaded = false;
 
     std::string customPath;
@@ -1364,10 +2073,15 @@ private:
     StatusComponent statusArea {15.0f, juce::Justification::centred};
     StatusComponent instructionsArea {13.0f, juce::Justification::centredLeft};
 
+    // keeps the settings file open for as long as HARP is running
+    SharedResourcePointer<SettingsStorage> settingsStorage;
+
     // the model itself
-    std::shared_ptr<WebWave2Wave> model {new WebWave2Wave()};
+    std::shared_ptr<Wave2Wave> model {new WebWave2Wave()};
 
     AudioDeviceManager audioDeviceManager;
+    bool audioDeviceOpen = false;
+    bool audioDeviceInitialised = false;
 
     std::unique_ptr<FileChooser> fileChooser;
 
@@ -1393,11 +2107,50 @@ private:
     /// CustomThreadPoolJob
     // This one is used for Loading the models
     // The thread pull for Processing lives inside the JobProcessorThread
-    ThreadPool threadPool {1};
+    // (both pools are only created once there is a job for them)
+    std::unique_ptr<ThreadPool> threadPool;
     int jobsFinished;
     int totalJobs;
     JobProcessorThread jobProcessorThread;
     std::vector<CustomThreadPoolJob*> customJobs;
+
+    // every version of the working copy, for undo/redo
+    VersionHistory history;
+    // what produced the result that is being processed, for the history
+    String processLabel;
+    // whether the last process or pipeline job finished with a result, set on the job thread
+    std::atomic<bool> processSucceeded {false};
+    // what Save was before that job, for when it has nothing to show for itself
+    bool saveEnabledBeforeJob = false;
+
+    // processes a short region whenever a control changes (Edit > Live Preview)
+    LivePreview livePreview;
+
+    // models chained with Pipeline > Add Model to Pipeline
+    ModelPipeline pipeline;
+    bool pipelineChunked = false;
+
+    // the localhost API for scripts, with a model of its own
+    ControlServer controlServer;
+
+    // models added with Compare > Add Model to Comparison
+    // (a model and a snapshot of its controls, just like a pipeline stage)
+    std::vector<PipelineStage> comparison;
+
+    // what the jobs in the JobProcessorThread are doing
+    enum class BatchKind { Process, Compare, Sweep };
+    BatchKind currentBatch = BatchKind::Process;
+    double batchStartTime = 0;
+    // per job flag files of a sweep or comparison, which can run many jobs on the same model
+    std::vector<JobFlags> batchFlags;
+    // where the results of the current batch are written, replaced by the next batch
+    File batchDir;
+
+    // results from comparisons, in their own window
+    ResultsComponent results;
+    std::unique_ptr<ResultsWindow> resultsWindow;
+    // separate from fileChooser, which Save As reuses
+    std::unique_ptr<FileChooser> exportChooser;
     
     ChangeBroadcaster loadBroadcaster;
     ChangeBroadcaster processBroadcaster;
@@ -1423,6 +2176,10 @@ private:
 
     void addNewAudioFile (URL resource) 
     {
+        // the working copy is about to be replaced, the history has to be done reading it
+        history.waitForCommits();
+        // re-opening the same file (e.g. after saving) keeps its history
+        bool keepHistory = (resource == currentAudioFileTarget) && history.getNumVersions() > 0;
         currentAudioFileTarget = resource;
         
         currentAudioFile = URL(File(
@@ -1439,9 +2196,33 @@ private:
         }
         DBG("MainComponent::addNewAudioFile: copied file to " << currentAudioFileTarget.getLocalFile().getFullPathName());
 
+        if (keepHistory) {
+            commitToHistory("saved");
+        } else {
+            // start a fresh history with the original file as its first version
+            history.reset(history.storeDirFor(currentAudioFile.getLocalFile().getParentDirectory().getChildFile(".history"),
+                                              currentAudioFileTarget.getLocalFile()));
+            commitToHistory("original");
+            thumbnail->clearSelection();
+        }
+        commandManager.commandStatusChanged();
+        livePreview.setSource(currentAudioFile.getLocalFile(), 0.0);
+
         playStopButton.setEnabled(true);
         showAudioResource(currentAudioFile);
         audioFileIsLoaded = true;
+        startPreupload();
+    }
+
+    // sends the working copy to the loaded space ahead of time, so Process
+    // can skip the upload (see the preUpload and uploadCacheSeconds settings)
+    void startPreupload()
+    {
+        auto* webModel = dynamic_cast<WebWave2Wave*>(model.get());
+        if (webModel == nullptr || !audioFileIsLoaded || !HARPSettings::getBool(settingkeys::preUpload)) {
+            return;
+        }
+        webModel->preupload(currentAudioFile.getLocalFile());
     }
 
     bool loadURLIntoTransport (const URL& audioURL)
@@ -1477,12 +2258,65 @@ private:
         return true;
     }
 
+    // opening the audio device can take a while, so it waits until something is played
+    void openAudioDevice() {
+        // playing again before the device was released keeps it
+        stopTimer();
+        if (audioDeviceOpen)
+            return;
+        audioDeviceOpen = true;
+        diagnostics::IdleMonitor::get().setActive("audio device", true);
+
+        // the read-ahead thread is stopped along with the device, since it polls even with nothing to read
+        if (!thread.isThreadRunning())
+            thread.startThread (Thread::Priority::normal);
+
+        if (!audioDeviceInitialised) {
+            auto error = audioDeviceManager.initialise (0, 2, nullptr, true, {}, nullptr);
+            if (error.isNotEmpty())
+                DBG("Failed to open the audio device: " + error);
+            audioDeviceInitialised = true;
+        } else {
+            audioDeviceManager.restartLastAudioDevice();
+        }
+        audioDeviceManager.addAudioCallback (&audioSourcePlayer);
+    }
+
+    // an open device keeps its audio callback running even in silence, so it is let go when nothing plays
+    void closeAudioDevice() {
+        if (!audioDeviceOpen)
+            return;
+        audioDeviceManager.removeAudioCallback (&audioSourcePlayer);
+        audioDeviceManager.closeAudioDevice();
+        thread.stopThread (1000);
+        audioDeviceOpen = false;
+        diagnostics::IdleMonitor::get().setActive("audio device", false);
+    }
+
+    void releaseAudioDeviceLater() {
+        if (audioDeviceOpen)
+            startTimer (jmax (0, roundToInt (HARPSettings::getDouble(settingkeys::releaseAudioAfter) * 1000.0)));
+    }
+
+    // hands the queued customJobs to the processing thread, starting it the first time
+    void startJobs() {
+        if (!jobProcessorThread.isThreadRunning())
+            jobProcessorThread.startThread();
+        watchModelStatus();
+        jobProcessorThread.signalTask();
+    }
+
+    // polls the status until the jobs and loads in progress are done
+    void watchModelStatus() {
+        mModelStatusTimer->watch();
+    }
+
     void play() {
+        openAudioDevice();
         if (!transportSource.isPlaying()) {
             // transportSource.setPosition (0);
             transportSource.start();
             playStopButton.setMode(stopButtonInfo.label);
-            startTimerHz(10);
         }
     }
 
@@ -1491,7 +2325,6 @@ private:
             transportSource.stop();
             transportSource.setPosition (0);
             playStopButton.setMode(playButtonInfo.label);
-            stopTimer();
         }
     }
 
@@ -1515,10 +2348,34 @@ private:
             } else if (thumbnail->getLastActionType() == ThumbnailComp::ActionType::TransportStarted) {
                 play();
 
+            } else if (thumbnail->getLastActionType() == ThumbnailComp::ActionType::SelectionChanged) {
+                auto selection = thumbnail->getSelection(currentAudioFile);
+                // live previews start where the selection does
+                livePreview.setSource(currentAudioFile.getLocalFile(), selection.getStart());
+                if (selection.isEmpty())
+                    setStatus("Selection cleared, Process will use the whole file");
+                else
+                    setStatus("Selected " + String(selection.getStart(), 2) + "s - " + String(selection.getEnd(), 2)
+                              + "s, Process will only use the selection");
+            }
+        }
+        else if (source == &transportSource) {
+            // stopped, either by stop() or by reaching the end of the file
+            if (!transportSource.isPlaying()) {
+                if (playStopButton.getModeName() == stopButtonInfo.label) {
+                    playStopButton.setMode(playButtonInfo.label);
+                    transportSource.setPosition (0.0);
+                }
+                releaseAudioDeviceLater();
             }
         }
         else if (source == &loadBroadcaster) {
             DBG("Setting up model card, CtrlComponent, resizing.");
+            isLoading = false;
+            // the load is done, and idle workers still wake up every half second
+            threadPool.reset();
+            mModelStatusTimer->setModel(model);
+            livePreview.setModel(model);
             setModelCard(model->card());
             ctrlComponent.setModel(model);
             ctrlComponent.populateGui();
@@ -1528,6 +2385,7 @@ private:
             if (model->ready()) {
                 processCancelButton.setEnabled(true);
                 processCancelButton.setMode(processButtonInfo.label);
+                startPreupload();
             }
 
             loadModelButton.setEnabled(true);
@@ -1539,22 +2397,46 @@ private:
             processCancelButton.grabKeyboardFocus();
             resized();
         }
+        else if (source == &processBroadcaster && currentBatch != BatchKind::Process) {
+            auto seconds = (Time::getMillisecondCounterHiRes() - batchStartTime) / 1000.0;
+            results.setHeading(String(results.getNumResults()) + " results in " + String(seconds, 1) + " s");
+            setStatus(currentBatch == BatchKind::Sweep ? "Sweep finished" : "Comparison finished");
+
+            batchFlags.clear();
+            currentBatch = BatchKind::Process;
+            processCancelButton.setMode(processButtonInfo.label);
+            processCancelButton.setEnabled(true);
+            isProcessing = false;
+            commandManager.commandStatusChanged();
+            openPendingHandoff();
+        }
         else if (source == &processBroadcaster) {
+            if (processSucceeded) {
+                // keep the result in the history so it can be undone
+                commitToHistory(processLabel);
+                livePreview.sourceChanged();
+                saveEnabled = true;
+            } else {
+                // a failed or cancelled job left the working copy as it was
+                saveEnabled = saveEnabledBeforeJob;
+            }
+
             // refresh the display for the new updated file
             showAudioResource(currentAudioFile);
 
             // now, we can enable the process button
             processCancelButton.setMode(processButtonInfo.label);
             processCancelButton.setEnabled(true);
-            saveEnabled = true;
             isProcessing = false;
+            commandManager.commandStatusChanged();
             repaint();
+            openPendingHandoff();
         }
         else if (source == mModelStatusTimer.get()) {
             // update the status label
             DBG("HARPProcessorEditor::changeListenerCallback: updating status label");
             // statusLabel.setText(model->getStatus(), dontSendNotification);
-            setStatus(model->getStatus());
+            setStatus(model->getStatusMessage());
         }
         else {
             DBG("HARPProcessorEditor::changeListenerCallback: unhandled change broadcaster");
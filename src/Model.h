@@ -28,6 +28,8 @@ namespace modelparams {
 
 struct ModelCard {
   int sampleRate;
+  // the channel counts the model takes, e.g. {1} for a model that sums to mono (empty = any)
+  std::vector<int> channels;
   std::string name;
   std::string description;
   std::string author;
@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @brief Picks the backend for a model path. builtin/ names are DSP models
+ * that come with HARP, .onnx files run in-process (when HARP is built with
+ * ONNX Runtime), anything else is a gradio space.
+ */
+
+#pragma once
+
+#include "WebModel.h"
+#include "OnnxModel.h"
+#include "NativeModels.h"
+
+namespace models {
+
+  // a fresh model for path, ready to be load()ed with {"url", path}
+  inline std::shared_ptr<Wave2Wave> create(const std::string& path) {
+    if (path == PitchShifter::name) {
+      return std::make_shared<PitchShifter>();
+    }
+    if (path == HarmonicPercussive::name) {
+      return std::make_shared<HarmonicPercussive>();
+    }
+   #if HARP_WITH_ONNXRUNTIME
+    if (OnnxModel::handles(path)) {
+      return std::make_shared<OnnxModel>();
+    }
+   #endif
+    return std::make_shared<WebWave2Wave>();
+  }
+
+  // the models that come with HARP
+  inline std::vector<std::string> builtins() {
+    return {PitchShifter::name, HarmonicPercussive::name};
+  }
+
+  inline bool isBuiltin(const std::string& path) {
+    auto names = builtins();
+    return std::find(names.begin(), names.end(), path) != names.end();
+  }
+
+  // whether path is a model on disk rather than a space
+  inline bool isLocal(const std::string& path) {
+    return juce::File::isAbsolutePath(juce::String(path).trim());
+  }
+}
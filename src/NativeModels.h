@@ -0,0 +1,438 @@
+/**
+ * @file
+ * @brief Models that are plain DSP, built into HARP. They have the same
+ * controls as the example spaces they replace (hugggof/pitch_shifter and
+ * hugggof/harmonic_percussive), but run locally without any upload, work
+ * offline and always give the same result, which makes them a useful
+ * baseline when benchmarking the remote path.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <thread>
+
+#include "Wave2Wave.h"
+#include "AudioUtils.h"
+
+#include "juce_dsp/juce_dsp.h"
+
+
+namespace nativedsp {
+
+  constexpr int fftOrder = 11;
+  constexpr int fftSize = 1 << fftOrder;
+  constexpr int hopSize = fftSize / 4;
+  constexpr int numBins = fftSize / 2 + 1;
+  // taps of the lowpass in front of a resampler that drops the rate
+  constexpr int lowpassOrder = 128;
+
+  // runs fn(0) ... fn(count - 1), spread over every core
+  inline void parallelFor(int count, const std::function<void(int)>& fn) {
+    const int numThreads = juce::jlimit(1, juce::jmax(1, count), juce::SystemStats::getNumCpus());
+    std::atomic<int> next {0};
+    auto work = [&] {
+      for (int i = next++; i < count; i = next++) {
+        fn(i);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; ++t) {
+      threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  // the frames of a short-time fourier transform, one after the other
+  struct Spectrogram {
+    int numFrames {0};
+    std::vector<std::complex<float>> bins;
+
+    std::complex<float>* frame(int i) { return bins.data() + (size_t) i * numBins; }
+    const std::complex<float>* frame(int i) const { return bins.data() + (size_t) i * numBins; }
+  };
+
+  inline const std::vector<float>& window() {
+    static const std::vector<float> values = [] {
+      std::vector<float> w(fftSize);
+      // periodic, so that overlapping windows add up to a constant
+      for (int i = 0; i < fftSize; ++i) {
+        w[(size_t) i] = 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * (float) i / (float) fftSize);
+      }
+      return w;
+    }();
+    return values;
+  }
+
+  // frames are centred on multiples of hopSize, the signal is padded with silence on both sides.
+  // stops early (leaving the rest of the frames empty) once cancelled is set.
+  inline Spectrogram stft(const float* samples, int numSamples, const std::atomic<bool>* cancelled = nullptr) {
+    juce::dsp::FFT fft(fftOrder);
+    std::vector<float> padded((size_t) (numSamples + 2 * fftSize), 0.0f);
+    juce::FloatVectorOperations::copy(padded.data() + fftSize / 2, samples, numSamples);
+
+    Spectrogram spec;
+    spec.numFrames = 1 + numSamples / hopSize;
+    spec.bins.resize((size_t) spec.numFrames * numBins);
+
+    std::vector<float> buffer(2 * fftSize);
+    for (int f = 0; f < spec.numFrames && !(cancelled != nullptr && *cancelled); ++f) {
+      juce::FloatVectorOperations::multiply(buffer.data(), padded.data() + f * hopSize, window().data(), fftSize);
+      fft.performRealOnlyForwardTransform(buffer.data(), true);
+      std::copy_n(reinterpret_cast<const std::complex<float>*>(buffer.data()), numBins, spec.frame(f));
+    }
+    return spec;
+  }
+
+  // the inverse of stft(), numSamples long
+  inline std::vector<float> istft(const Spectrogram& spec, int numSamples) {
+    juce::dsp::FFT fft(fftOrder);
+    const size_t paddedLength = (size_t) (spec.numFrames * hopSize + 2 * fftSize);
+    std::vector<float> output(paddedLength, 0.0f);
+    std::vector<float> norm(paddedLength, 0.0f);
+    std::vector<float> squaredWindow(fftSize);
+    juce::FloatVectorOperations::multiply(squaredWindow.data(), window().data(), window().data(), fftSize);
+
+    std::vector<float> buffer(2 * fftSize);
+    for (int f = 0; f < spec.numFrames; ++f) {
+      std::fill(buffer.begin(), buffer.end(), 0.0f);
+      std::copy_n(spec.frame(f), numBins, reinterpret_cast<std::complex<float>*>(buffer.data()));
+      fft.performRealOnlyInverseTransform(buffer.data());
+      juce::FloatVectorOperations::multiply(buffer.data(), window().data(), fftSize);
+      juce::FloatVectorOperations::add(output.data() + f * hopSize, buffer.data(), fftSize);
+      juce::FloatVectorOperations::add(norm.data() + f * hopSize, squaredWindow.data(), fftSize);
+    }
+
+    std::vector<float> samples((size_t) numSamples);
+    for (int i = 0; i < numSamples; ++i) {
+      const auto n = norm[(size_t) (i + fftSize / 2)];
+      samples[(size_t) i] = n > 1.0e-6f ? output[(size_t) (i + fftSize / 2)] / n : 0.0f;
+    }
+    return samples;
+  }
+
+  // stretches the signal to ratio times its length without changing its pitch (a phase vocoder).
+  // once cancelled is set, the rest of the output is left silent.
+  inline std::vector<float> timeStretch(const float* samples, int numSamples, double ratio,
+                                        const std::atomic<bool>* cancelled = nullptr) {
+    const auto input = stft(samples, numSamples, cancelled);
+    if (input.numFrames < 2) {
+      return std::vector<float>(samples, samples + numSamples);
+    }
+
+    Spectrogram output;
+    output.numFrames = (int) std::ceil((input.numFrames - 1) * ratio);
+    output.bins.resize((size_t) output.numFrames * numBins);
+
+    // the phase a bin advances by in one hop, if it sits exactly on its centre frequency
+    std::vector<float> expectedAdvance(numBins);
+    for (int k = 0; k < numBins; ++k) {
+      expectedAdvance[(size_t) k] = juce::MathConstants<float>::twoPi * (float) k * hopSize / (float) fftSize;
+    }
+    std::vector<float> phase(numBins);
+    for (int k = 0; k < numBins; ++k) {
+      phase[(size_t) k] = std::arg(input.frame(0)[k]);
+    }
+
+    for (int f = 0; f < output.numFrames && !(cancelled != nullptr && *cancelled); ++f) {
+      const double position = f / ratio;
+      const int i = juce::jmin((int) position, input.numFrames - 2);
+      const auto alpha = (float) (position - i);
+      const auto* a = input.frame(i);
+      const auto* b = input.frame(i + 1);
+      auto* out = output.frame(f);
+
+      for (int k = 0; k < numBins; ++k) {
+        const float magnitude = (1.0f - alpha) * std::abs(a[k]) + alpha * std::abs(b[k]);
+        out[k] = std::polar(magnitude, phase[(size_t) k]);
+
+        // how far the bin is off its centre frequency, wrapped to [-pi, pi]
+        float deviation = std::arg(b[k]) - std::arg(a[k]) - expectedAdvance[(size_t) k];
+        deviation -= juce::MathConstants<float>::twoPi * std::round(deviation / juce::MathConstants<float>::twoPi);
+        phase[(size_t) k] += expectedAdvance[(size_t) k] + deviation;
+      }
+    }
+    return istft(output, (int) std::round(numSamples * ratio));
+  }
+
+  // filters samples (at sampleRate) with a linear phase lowpass at cutoff. the filter's
+  // delay is taken out, so the output still lines up with the input.
+  inline void lowpass(std::vector<float>& samples, double cutoff, double sampleRate) {
+    juce::dsp::FIR::Filter<float> filter(juce::dsp::FilterDesign<float>::designFIRLowpassWindowMethod(
+        (float) cutoff, sampleRate, (size_t) lowpassOrder, juce::dsp::WindowingFunction<float>::blackman));
+    const size_t delay = lowpassOrder / 2;
+    // silence at the end flushes the last samples out of the filter
+    samples.resize(samples.size() + delay, 0.0f);
+    float* channels[] = {samples.data()};
+    juce::dsp::AudioBlock<float> block(channels, 1, samples.size());
+    filter.process(juce::dsp::ProcessContextReplacing<float>(block));
+    samples.erase(samples.begin(), samples.begin() + (std::ptrdiff_t) delay);
+  }
+
+  // out[i] is the median of in[i - kernel / 2 ... i + kernel / 2], with the edges repeated
+  inline void medianFilter(const float* in, float* out, int count, int stride, int kernel) {
+    std::vector<float> window((size_t) kernel);
+    for (int i = 0; i < count; ++i) {
+      for (int j = 0; j < kernel; ++j) {
+        const int index = juce::jlimit(0, count - 1, i + j - kernel / 2);
+        window[(size_t) j] = in[(size_t) index * (size_t) stride];
+      }
+      std::nth_element(window.begin(), window.begin() + kernel / 2, window.end());
+      out[(size_t) i * (size_t) stride] = window[(size_t) (kernel / 2)];
+    }
+  }
+}
+
+
+/**
+ * @class NativeModel
+ * @brief A model that runs as DSP code inside HARP. Subclasses describe
+ * themselves with the same json spec as a space, and render() the audio.
+ */
+class NativeModel : public Wave2Wave {
+public:
+  using Wave2Wave::process;
+
+  std::string space_url() const override { return m_name; }
+
+  void load(const map<string, any> &params) override {
+    m_ctrls.clear();
+    m_loaded = false;
+    loadSpec(juce::JSON::parse(spec()));
+    m_loaded = true;
+
+    // set the status to LOADED
+    m_status_flag_file.replaceWithText("Status.LOADED");
+  }
+
+  bool process(juce::File filetoProcess, const CtrlList& ctrls, const JobFlags& flags) const override {
+    LogAndDBG("NativeModel::process " + juce::String(m_name));
+    if (!m_loaded) {
+      throw std::runtime_error("Model not loaded");
+    }
+    flags.status.replaceWithText("Status.PROCESSING");
+
+    try {
+      juce::AudioBuffer<float> audio;
+      double sampleRate = 0;
+      if (!audioutils::readFile(filetoProcess, audio, sampleRate)) {
+        throw std::runtime_error("Failed to read " + filetoProcess.getFullPathName().toStdString());
+      }
+
+      // long files take a while to render, this watches the cancel flag so render() can stop early
+      std::atomic<bool> cancelled {false};
+      std::atomic<bool> finished {false};
+      std::thread watcher([&cancelled, &finished, &flags] {
+        while (!finished) {
+          if (flags.cancel.exists()) {
+            cancelled = true;
+            return;
+          }
+          juce::Thread::sleep(cancelPollIntervalMs);
+        }
+      });
+
+      const double startedAt = juce::Time::getMillisecondCounterHiRes();
+      try {
+        render(audio, sampleRate, ctrls, cancelled);
+      } catch (...) {
+        finished = true;
+        watcher.join();
+        throw;
+      }
+      finished = true;
+      watcher.join();
+      LogAndDBG(juce::String(m_name) + ": rendered in " + juce::String(juce::Time::getMillisecondCounterHiRes() - startedAt, 1) + " ms");
+
+      // a render that was stopped early is incomplete, so it is dropped
+      if (cancelled || flags.cancel.exists()) {
+        flags.status.replaceWithText("Status.CANCELED");
+        flags.cancel.deleteFile();
+        return false;
+      }
+
+      // written next to the file it replaces, so the move is a rename
+      auto tempOutputFile = filetoProcess.getSiblingFile(".harp_output_" + juce::Uuid().toString() + ".wav");
+      if (!audioutils::writeWav(tempOutputFile, audio, sampleRate) || !tempOutputFile.moveFileTo(filetoProcess)) {
+        tempOutputFile.deleteFile();
+        throw std::runtime_error("Failed to write the output to " + filetoProcess.getFullPathName().toStdString());
+      }
+    } catch (...) {
+      flags.status.replaceWithText("Status.ERROR");
+      throw;
+    }
+
+    flags.status.replaceWithText("Status.FINISHED");
+    return true;
+  }
+
+protected:
+  explicit NativeModel(std::string name) : m_name(std::move(name)) {}
+
+  // the card and controls, in the format get_ctrls returns for a space
+  virtual juce::String spec() const = 0;
+
+  // processes audio in place. once cancelled is set, render() should return as soon as it
+  // can, the audio is thrown away then.
+  virtual void render(juce::AudioBuffer<float>& audio, double sampleRate, const CtrlList& ctrls,
+                      const std::atomic<bool>& cancelled) const = 0;
+
+  static double sliderValue(const CtrlList& ctrls, const std::string& label) {
+    for (const auto& ctrl : ctrls) {
+      if (auto slider = dynamic_cast<const SliderCtrl*>(ctrl.second.get()); slider != nullptr && slider->label == label) {
+        return slider->value;
+      }
+    }
+    throw std::runtime_error("The control " + label + " is missing.");
+  }
+
+private:
+  static constexpr int cancelPollIntervalMs = 20;
+
+  std::string m_name;
+};
+
+
+class PitchShifter : public NativeModel {
+public:
+  PitchShifter() : NativeModel(name) {}
+
+  static constexpr const char* name = "builtin/pitch_shifter";
+
+protected:
+  juce::String spec() const override {
+    return R"({
+      "card": {
+        "name": "Pitch Shifter",
+        "description": "Shifts the pitch of the audio without changing its length. Runs inside HARP, no connection needed.",
+        "author": "HARP",
+        "tags": ["builtin", "pitch shift"]
+      },
+      "ctrls": [
+        {"ctrl_type": "audio_in", "label": "Audio Input"},
+        {"ctrl_type": "slider", "label": "Pitch Shift (semitones)", "minimum": -24, "maximum": 24, "step": 1, "value": 7}
+      ]
+    })";
+  }
+
+  // stretches the audio by the pitch ratio, then resamples it back to its original length
+  void render(juce::AudioBuffer<float>& audio, double sampleRate, const CtrlList& ctrls,
+              const std::atomic<bool>& cancelled) const override {
+    const double ratio = std::pow(2.0, sliderValue(ctrls, "Pitch Shift (semitones)") / 12.0);
+    if (ratio == 1.0 || audio.getNumSamples() == 0) {
+      return;
+    }
+
+    const int numSamples = audio.getNumSamples();
+    std::vector<std::vector<float>> stretched((size_t) audio.getNumChannels());
+    nativedsp::parallelFor(audio.getNumChannels(), [&] (int ch) {
+      stretched[(size_t) ch] = nativedsp::timeStretch(audio.getReadPointer(ch), numSamples, ratio, &cancelled);
+      if (ratio > 1.0 && !cancelled) {
+        // played faster, everything above nyquist / ratio would fold back down as aliasing
+        nativedsp::lowpass(stretched[(size_t) ch], 0.45 * sampleRate / ratio, sampleRate);
+      }
+    });
+    if (cancelled) {
+      return;
+    }
+
+    juce::AudioBuffer<float> result(audio.getNumChannels(), (int) stretched.front().size());
+    for (int ch = 0; ch < audio.getNumChannels(); ++ch) {
+      result.copyFrom(ch, 0, stretched[(size_t) ch].data(), result.getNumSamples());
+    }
+    // played back ratio times faster, which is what brings the pitch up
+    audioutils::conform(result, sampleRate * ratio, sampleRate, audio.getNumChannels());
+
+    audio.setSize(audio.getNumChannels(), numSamples, false, true);
+    for (int ch = 0; ch < audio.getNumChannels(); ++ch) {
+      audio.copyFrom(ch, 0, result, ch, 0, juce::jmin(numSamples, result.getNumSamples()));
+    }
+  }
+};
+
+
+class HarmonicPercussive : public NativeModel {
+public:
+  HarmonicPercussive() : NativeModel(name) {}
+
+  static constexpr const char* name = "builtin/harmonic_percussive";
+
+protected:
+  juce::String spec() const override {
+    return R"({
+      "card": {
+        "name": "Harmonic / Percussive Separation",
+        "description": "Sets the level of the harmonic and percussive parts of the audio, using median filtering. Runs inside HARP, no connection needed.",
+        "author": "HARP",
+        "tags": ["builtin", "separator", "hpss"]
+      },
+      "ctrls": [
+        {"ctrl_type": "audio_in", "label": "Audio Input"},
+        {"ctrl_type": "slider", "label": "Harmonic Level (dB)", "minimum": -60, "maximum": 12, "step": 1, "value": 0},
+        {"ctrl_type": "slider", "label": "Percussive Level (dB)", "minimum": -60, "maximum": 12, "step": 1, "value": -60},
+        {"ctrl_type": "slider", "label": "Kernel Size", "minimum": 3, "maximum": 101, "step": 2, "value": 31},
+        {"ctrl_type": "slider", "label": "Margin", "minimum": 1, "maximum": 5, "step": 0.5, "value": 1}
+      ]
+    })";
+  }
+
+  // median filtering across time keeps what is steady (harmonic), across frequency what is
+  // broadband (percussive). the two are turned into soft masks and mixed at the chosen levels.
+  void render(juce::AudioBuffer<float>& audio, double, const CtrlList& ctrls,
+              const std::atomic<bool>& cancelled) const override {
+    // -60 dB and below is silence
+    auto gain = [] (double db) { return (float) juce::Decibels::decibelsToGain(db, -60.0); };
+    const float harmonicGain = gain(sliderValue(ctrls, "Harmonic Level (dB)"));
+    const float percussiveGain = gain(sliderValue(ctrls, "Percussive Level (dB)"));
+    const int kernel = juce::jmax(1, juce::roundToInt(sliderValue(ctrls, "Kernel Size")) | 1);
+    const float margin = (float) juce::jmax(1.0, sliderValue(ctrls, "Margin"));
+
+    const int numSamples = audio.getNumSamples();
+    for (int ch = 0; ch < audio.getNumChannels() && !cancelled; ++ch) {
+      auto spec = nativedsp::stft(audio.getReadPointer(ch), numSamples, &cancelled);
+      const int numFrames = spec.numFrames;
+      const size_t size = spec.bins.size();
+
+      std::vector<float> magnitude(size), harmonic(size), percussive(size);
+      for (size_t i = 0; i < size; ++i) {
+        magnitude[i] = std::abs(spec.bins[i]);
+      }
+      // each bin along time, each frame along frequency
+      nativedsp::parallelFor(nativedsp::numBins, [&] (int k) {
+        if (cancelled) {
+          return;
+        }
+        nativedsp::medianFilter(magnitude.data() + k, harmonic.data() + k, numFrames, nativedsp::numBins, kernel);
+      });
+      nativedsp::parallelFor(numFrames, [&] (int f) {
+        if (cancelled) {
+          return;
+        }
+        const size_t offset = (size_t) f * nativedsp::numBins;
+        nativedsp::medianFilter(magnitude.data() + offset, percussive.data() + offset, nativedsp::numBins, 1, kernel);
+      });
+
+      for (size_t i = 0; i < size; ++i) {
+        const float h = harmonic[i] * harmonic[i];
+        const float p = percussive[i] * percussive[i];
+        // a margin above 1 leaves out what isn't clearly one or the other
+        const float hm = margin * margin * h;
+        const float pm = margin * margin * p;
+        const float harmonicMask = h + pm > 1.0e-12f ? h / (h + pm) : 0.5f;
+        const float percussiveMask = p + hm > 1.0e-12f ? p / (p + hm) : 0.5f;
+        spec.bins[i] *= harmonicGain * harmonicMask + percussiveGain * percussiveMask;
+      }
+      if (cancelled) {
+        return;
+      }
+
+      auto result = nativedsp::istft(spec, numSamples);
+      audio.copyFrom(ch, 0, result.data(), numSamples);
+    }
+  }
+};
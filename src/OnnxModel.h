@@ -0,0 +1,341 @@
+/**
+ * @file
+ * @brief A wave 2 wave model that runs an exported ONNX graph on the CPU,
+ * inside HARP. There is no space, helper or upload involved, so a job costs
+ * only the inference itself. Only built with -DHARP_WITH_ONNXRUNTIME=ON.
+ *
+ * A model is a .onnx file with a .json file of the same name next to it. The
+ * json is the same spec get_ctrls returns for a space ("card" and "ctrls"),
+ * so the UI shows these models like any other. The graph takes:
+ *  - "audio": float samples, shaped [channels, samples], [1, channels, samples]
+ *    or [samples] for mono models, at the card's "sample_rate" (if it has one)
+ *  - one input per control, named after its label, holding a single value
+ *    (dropdowns pass the index of the chosen option, text boxes a string)
+ * and the first output is the processed audio, in the same layout as "audio".
+ */
+
+#pragma once
+
+#if HARP_WITH_ONNXRUNTIME
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include <onnxruntime_cxx_api.h>
+
+#include "Wave2Wave.h"
+#include "AudioUtils.h"
+
+
+class OnnxModel : public Wave2Wave {
+public:
+  using Wave2Wave::process;
+
+  // any path to a .onnx file is one of ours
+  static bool handles(const juce::String& path) {
+    return path.trim().endsWithIgnoreCase(".onnx");
+  }
+
+  std::string space_url() const override { return m_path.getFullPathName().toStdString(); }
+
+  void load(const map<string, any> &params) override {
+    m_ctrls.clear();
+    m_loaded = false;
+    m_session.reset();
+    m_inputs.clear();
+
+    // the same params as a space, except that the url is a file
+    if (!modelparams::contains(params, "url")) {
+        throw std::runtime_error("url not found in params");
+    }
+    m_path = juce::File(std::any_cast<std::string>(params.at("url")));
+    LogAndDBG("onnx model: " + m_path.getFullPathName());
+    if (!m_path.existsAsFile()) {
+        throw std::runtime_error("The model file " + space_url() + " does not exist.");
+    }
+
+    auto specFile = m_path.withFileExtension(".json");
+    juce::var spec = loadJsonFromFile(specFile);
+    if (spec.isVoid()) {
+        throw std::runtime_error("Failed to load controls from " + specFile.getFullPathName().toStdString()
+                                 + ". An .onnx model needs a .json spec with the same name next to it.");
+    }
+    loadSpec(spec);
+
+    Ort::SessionOptions options;
+    // several jobs can run at once (sweeps, comparisons, live preview), so every
+    // session shares the one pool of env() instead of each having a pool per core
+    options.DisablePerSessionThreads();
+    options.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+
+    try {
+     #if JUCE_WINDOWS
+      m_session = std::make_unique<Ort::Session>(env(), m_path.getFullPathName().toWideCharPointer(), options);
+     #else
+      m_session = std::make_unique<Ort::Session>(env(), m_path.getFullPathName().toRawUTF8(), options);
+     #endif
+
+      Ort::AllocatorWithDefaultOptions allocator;
+      for (size_t i = 0; i < m_session->GetInputCount(); i++) {
+        auto info = m_session->GetInputTypeInfo(i).GetTensorTypeAndShapeInfo();
+        m_inputs.push_back({m_session->GetInputNameAllocated(i, allocator).get(),
+                            info.GetElementType(), info.GetShape()});
+      }
+      if (m_session->GetOutputCount() == 0) {
+          throw std::runtime_error("The model " + space_url() + " has no outputs.");
+      }
+      m_outputName = m_session->GetOutputNameAllocated(0, allocator).get();
+    }
+    catch (const Ort::Exception& e) {
+        throw std::runtime_error("ONNX Runtime failed to load " + space_url() + ": " + e.what());
+    }
+
+    // every input has to come from somewhere, better to find out now than on the first job
+    auto ctrls = m_ctrls.snapshot();
+    for (const auto& input : m_inputs) {
+      if (input.name != audioInputName && findCtrl(*ctrls, input.name) == nullptr) {
+          throw std::runtime_error("The model " + space_url() + " has an input called " + input.name
+                                   + ", but no control with that label.");
+      }
+    }
+    if (std::none_of(m_inputs.begin(), m_inputs.end(), [] (const Input& input) { return input.name == audioInputName; })) {
+        throw std::runtime_error("The model " + space_url() + " has no input called " + audioInputName + ".");
+    }
+
+    m_loaded = true;
+
+    // set the status to LOADED
+    m_status_flag_file.replaceWithText("Status.LOADED");
+  }
+
+  bool process(juce::File filetoProcess, const CtrlList& ctrls, const JobFlags& flags) const override {
+    LogAndDBG("OnnxModel::process");
+    if (!m_loaded) {
+      throw std::runtime_error("Model not loaded");
+    }
+    flags.status.replaceWithText("Status.PROCESSING");
+
+    juce::AudioBuffer<float> audio;
+    double sampleRate = 0;
+    if (!audioutils::readFile(filetoProcess, audio, sampleRate)) {
+      throw std::runtime_error("Failed to read " + filetoProcess.getFullPathName().toStdString());
+    }
+    const double modelSampleRate = m_card.sampleRate > 0 ? (double) m_card.sampleRate : sampleRate;
+
+    std::vector<Ort::Value> values;
+    std::vector<const char*> names;
+    try {
+      for (const auto& input : m_inputs) {
+        if (input.name == audioInputName) {
+          values.push_back(audioTensor(audio, sampleRate, modelSampleRate, input));
+        } else {
+          values.push_back(ctrlTensor(*findCtrl(ctrls, input.name), input));
+        }
+        names.push_back(input.name.c_str());
+      }
+    }
+    catch (const Ort::Exception& e) {
+      throw std::runtime_error(std::string("Failed to prepare the model's inputs: ") + e.what());
+    }
+
+    // the run can't look at the cancel flag itself, so this watches it and terminates the run
+    Ort::RunOptions runOptions;
+    std::atomic<bool> finished {false};
+    std::thread watcher([&runOptions, &finished, &flags] {
+      while (!finished) {
+        if (flags.cancel.exists()) {
+          runOptions.SetTerminate();
+          return;
+        }
+        juce::Thread::sleep(cancelPollIntervalMs);
+      }
+    });
+
+    const double startedAt = juce::Time::getMillisecondCounterHiRes();
+    std::vector<Ort::Value> outputs;
+    std::string error;
+    const char* outputName = m_outputName.c_str();
+    try {
+      outputs = m_session->Run(runOptions, names.data(), values.data(), values.size(), &outputName, 1);
+    }
+    catch (const Ort::Exception& e) {
+      error = e.what();
+    }
+    finished = true;
+    watcher.join();
+    LogAndDBG("OnnxModel: ran in " + juce::String(juce::Time::getMillisecondCounterHiRes() - startedAt, 0) + " ms");
+
+    // a terminated run also ends in an exception, the flag tells them apart
+    if (flags.cancel.exists()) {
+      flags.status.replaceWithText("Status.CANCELED");
+      flags.cancel.deleteFile();
+      return false;
+    }
+    if (!error.empty()) {
+      flags.status.replaceWithText("Status.ERROR");
+      throw std::runtime_error("The model failed: " + error
+                               + "\n Check the logs " + getLogFile().getFullPathName().toStdString() + " for more details.");
+    }
+
+    auto result = outputBuffer(outputs.front());
+    // written next to the file it replaces, so the move is a rename
+    auto tempOutputFile = filetoProcess.getSiblingFile(".harp_output_" + juce::Uuid().toString() + ".wav");
+    if (!audioutils::writeWav(tempOutputFile, result, modelSampleRate)) {
+      tempOutputFile.deleteFile();
+      throw std::runtime_error("Failed to write the output of the model.");
+    }
+    if (!tempOutputFile.moveFileTo(filetoProcess)) {
+      tempOutputFile.deleteFile();
+      throw std::runtime_error("Failed to move the output to " + filetoProcess.getFullPathName().toStdString());
+    }
+
+    flags.status.replaceWithText("Status.FINISHED");
+    LogAndDBG("OnnxModel::process done");
+    return true;
+  }
+
+private:
+  static constexpr const char* audioInputName = "audio";
+  static constexpr int cancelPollIntervalMs = 20;
+
+  struct Input {
+    std::string name;
+    ONNXTensorElementDataType type;
+    // -1 for dimensions the graph leaves open
+    std::vector<int64_t> shape;
+  };
+
+  // one per process, shared by every session along with its thread pool:
+  // a thread per core for the work inside an operator, no threads to run operators side by side
+  static Ort::Env& env() {
+    static Ort::Env instance = [] {
+      Ort::ThreadingOptions threading;
+      threading.SetGlobalIntraOpNumThreads(juce::SystemStats::getNumCpus());
+      threading.SetGlobalInterOpNumThreads(1);
+      return Ort::Env(threading, ORT_LOGGING_LEVEL_WARNING, "HARP");
+    }();
+    return instance;
+  }
+
+  static const Ctrl* findCtrl(const CtrlList& ctrls, const std::string& label) {
+    for (const auto& ctrl : ctrls) {
+      if (ctrl.second->label == label) {
+        return ctrl.second.get();
+      }
+    }
+    return nullptr;
+  }
+
+  // the audio, resampled to the model's rate and laid out the way the graph wants it
+  static Ort::Value audioTensor(juce::AudioBuffer<float> audio, double sampleRate,
+                                double modelSampleRate, const Input& input) {
+    if (input.type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || input.shape.empty() || input.shape.size() > 3) {
+      throw std::runtime_error("The audio input of the model has to be a float tensor of [samples], "
+                               "[channels, samples] or [1, channels, samples].");
+    }
+    // mono graphs get a mono mix, graphs with a fixed number of channels get that many
+    int channels = audio.getNumChannels();
+    if (input.shape.size() == 1) {
+      channels = 1;
+    } else if (input.shape[input.shape.size() - 2] > 0) {
+      channels = (int) input.shape[input.shape.size() - 2];
+    }
+    if (channels == 1 && audio.getNumChannels() > 1) {
+      audio = audioutils::downmix(audio);
+    }
+    audioutils::conform(audio, sampleRate, modelSampleRate, channels);
+
+    std::vector<int64_t> shape {(int64_t) audio.getNumSamples()};
+    if (input.shape.size() >= 2) {
+      shape.insert(shape.begin(), (int64_t) channels);
+    }
+    if (input.shape.size() == 3) {
+      shape.insert(shape.begin(), 1);
+    }
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    auto tensor = Ort::Value::CreateTensor<float>(allocator, shape.data(), shape.size());
+    auto* data = tensor.GetTensorMutableData<float>();
+    for (int ch = 0; ch < channels; ++ch) {
+      std::copy_n(audio.getReadPointer(ch), audio.getNumSamples(), data + (size_t) ch * (size_t) audio.getNumSamples());
+    }
+    return tensor;
+  }
+
+  // a single value holding the control's current value, in the graph's type
+  static Ort::Value ctrlTensor(const Ctrl& ctrl, const Input& input) {
+    // open dimensions are 1, anything else has to be 1 already
+    std::vector<int64_t> shape;
+    for (auto dim : input.shape) {
+      if (dim > 1) {
+        throw std::runtime_error("The input " + input.name + " has to hold a single value.");
+      }
+      shape.push_back(1);
+    }
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    auto tensor = Ort::Value::CreateTensor(allocator, shape.data(), shape.size(), input.type);
+
+    if (auto text = dynamic_cast<const TextBoxCtrl*>(&ctrl)) {
+      if (input.type != ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING) {
+        throw std::runtime_error("The input " + input.name + " has to be a string tensor.");
+      }
+      tensor.FillStringTensorElement(text->value.c_str(), 0);
+      return tensor;
+    }
+
+    double value = 0;
+    if (auto slider = dynamic_cast<const SliderCtrl*>(&ctrl)) {
+      value = slider->value;
+    } else if (auto numberBox = dynamic_cast<const NumberBoxCtrl*>(&ctrl)) {
+      value = numberBox->value;
+    } else if (auto toggle = dynamic_cast<const ToggleCtrl*>(&ctrl)) {
+      value = toggle->value ? 1.0 : 0.0;
+    } else if (auto comboBox = dynamic_cast<const ComboBoxCtrl*>(&ctrl)) {
+      auto option = std::find(comboBox->options.begin(), comboBox->options.end(), comboBox->value);
+      value = (double) std::distance(comboBox->options.begin(), option);
+    } else {
+      throw std::runtime_error("The control " + ctrl.label + " can't be passed to an onnx model.");
+    }
+
+    switch (input.type) {
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: *tensor.GetTensorMutableData<float>() = (float) value; break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE: *tensor.GetTensorMutableData<double>() = value; break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32: *tensor.GetTensorMutableData<int32_t>() = (int32_t) std::lround(value); break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64: *tensor.GetTensorMutableData<int64_t>() = (int64_t) std::llround(value); break;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL: *tensor.GetTensorMutableData<bool>() = value != 0; break;
+      default:
+        throw std::runtime_error("The input " + input.name + " has a type HARP can't fill in.");
+    }
+    return tensor;
+  }
+
+  static juce::AudioBuffer<float> outputBuffer(const Ort::Value& output) {
+    auto info = output.GetTensorTypeAndShapeInfo();
+    auto shape = info.GetShape();
+    if (info.GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || shape.empty() || shape.size() > 3
+        || (shape.size() == 3 && shape[0] != 1)) {
+      throw std::runtime_error("The output of the model has to be a float tensor of [samples], "
+                               "[channels, samples] or [1, channels, samples].");
+    }
+    const int numSamples = (int) shape.back();
+    const int channels = shape.size() == 1 ? 1 : (int) shape[shape.size() - 2];
+
+    juce::AudioBuffer<float> buffer(channels, numSamples);
+    const auto* data = output.GetTensorData<float>();
+    for (int ch = 0; ch < channels; ++ch) {
+      buffer.copyFrom(ch, 0, data + (size_t) ch * (size_t) numSamples, numSamples);
+    }
+    return buffer;
+  }
+
+  juce::File m_path;
+  std::unique_ptr<Ort::Session> m_session;
+  std::vector<Input> m_inputs;
+  std::string m_outputName;
+};
+
+#endif
@@ -0,0 +1,263 @@
+/**
+ * @file
+ * @brief Chains several loaded models, each with its own control values, so
+ * that audio runs through all of them in one go. Intermediate results are
+ * handed straight from one model's helper to the next, without ever touching
+ * the working copy or the waveform display.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+#include "Wave2Wave.h"
+#include "AudioUtils.h"
+
+struct PipelineStage {
+  std::shared_ptr<Wave2Wave> model;
+  // the model's controls at the time the stage was added
+  CtrlSnapshot ctrls;
+};
+
+
+class ModelPipeline {
+public:
+  // adds model as the last stage, with a snapshot of its current control values
+  void addStage(std::shared_ptr<Wave2Wave> model) {
+    m_stages.push_back({model, model->controls()});
+  }
+
+  void clear() { m_stages.clear(); }
+  bool empty() const { return m_stages.empty(); }
+  size_t size() const { return m_stages.size(); }
+
+  juce::String getDescription() const {
+    juce::StringArray names;
+    for (const auto& stage : m_stages) {
+      names.add(stage.model->card().name.empty() ? juce::String(stage.model->space_url())
+                                                 : juce::String(stage.model->card().name));
+    }
+    return names.joinIntoString(" -> ");
+  }
+
+  // when chunkSeconds > 0, the input is split into chunks of that length,
+  // so that chunk k can be in stage s + 1 while chunk k + 1 is in stage s.
+  // neighbouring chunks overlap by overlapSeconds and are crossfaded back together.
+  void setChunking(double chunkSeconds, double overlapSeconds) {
+    m_chunkSeconds = chunkSeconds;
+    m_overlapSeconds = overlapSeconds;
+  }
+
+  /**
+   * @brief Runs fileToProcess through every stage in order and writes the final result back to it.
+   * @param onProgress called from the worker threads with a short description of what is running.
+   * @return false if the pipeline was cancelled, in which case fileToProcess is left untouched.
+   * will throw a std::runtime_error if any stage fails.
+   */
+  bool process(juce::File fileToProcess,
+               std::function<void(const juce::String&)> onProgress = nullptr) {
+    if (m_stages.empty()) {
+      throw std::runtime_error("The pipeline is empty. Add at least one model to it first.");
+    }
+    m_cancelled = false;
+
+    auto tempDir = juce::File::getSpecialLocation(juce::File::tempDirectory);
+    auto prefix = "pipeline_" + juce::Uuid().toString();
+
+    juce::AudioBuffer<float> input;
+    double sampleRate = 0;
+    bool chunked = m_chunkSeconds > 0
+                   && audioutils::readFile(fileToProcess, input, sampleRate)
+                   && input.getNumSamples() > (int) (m_chunkSeconds * sampleRate);
+
+    if (!chunked) {
+      // one chunk: the same file is handed from one helper to the next
+      auto work = tempDir.getChildFile(prefix + ".wav");
+      if (!fileToProcess.copyFileTo(work)) {
+        throw std::runtime_error("Failed to copy the input for the pipeline.");
+      }
+
+      for (size_t s = 0; s < m_stages.size() && !m_cancelled; ++s) {
+        if (onProgress) {
+          onProgress("Pipeline stage " + juce::String((int) s + 1) + "/" + juce::String((int) m_stages.size()));
+        }
+        try {
+          runStage(s, work);
+        } catch (...) {
+          work.deleteFile();
+          throw;
+        }
+      }
+
+      if (m_cancelled) {
+        work.deleteFile();
+        return false;
+      }
+      if (!work.moveFileTo(fileToProcess)) {
+        work.deleteFile();
+        throw std::runtime_error("Failed to write the pipeline output to " + fileToProcess.getFullPathName().toStdString());
+      }
+      return true;
+    }
+
+    // write every chunk to its own file
+    auto overlap = (juce::int64) (m_overlapSeconds * sampleRate);
+    auto ranges = audioutils::makeChunks(input.getNumSamples(), (juce::int64) (m_chunkSeconds * sampleRate), overlap);
+    std::vector<juce::File> chunkFiles;
+    auto cleanup = [&chunkFiles] {
+      for (auto& file : chunkFiles) {
+        file.deleteFile();
+      }
+    };
+
+    for (size_t k = 0; k < ranges.size(); ++k) {
+      juce::AudioBuffer<float> chunk(input.getNumChannels(), (int) ranges[k].getLength());
+      for (int ch = 0; ch < input.getNumChannels(); ++ch) {
+        chunk.copyFrom(ch, 0, input, ch, (int) ranges[k].getStart(), (int) ranges[k].getLength());
+      }
+      chunkFiles.push_back(tempDir.getChildFile(prefix + "_" + juce::String((int) k) + ".wav"));
+      if (!audioutils::writeWav(chunkFiles.back(), chunk, sampleRate)) {
+        cleanup();
+        throw std::runtime_error("Failed to write a chunk for the pipeline.");
+      }
+    }
+
+    // one worker per stage. stage s takes chunk k as soon as stage s - 1 is done with it.
+    std::mutex mutex;
+    std::condition_variable progressed;
+    std::vector<size_t> numDone(m_stages.size(), 0);
+    size_t numStagesFinished = 0;
+    std::string error;
+
+    juce::ThreadPool workers((int) m_stages.size());
+    for (size_t s = 0; s < m_stages.size(); ++s) {
+      workers.addJob([&, s] {
+        for (size_t k = 0; k < chunkFiles.size(); ++k) {
+          bool stop = false;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            progressed.wait(lock, [&] {
+              return m_cancelled || !error.empty() || s == 0 || numDone[s - 1] > k;
+            });
+            stop = m_cancelled || !error.empty();
+          }
+          if (stop) {
+            break;
+          }
+
+          if (onProgress) {
+            onProgress("Pipeline stage " + juce::String((int) s + 1) + "/" + juce::String((int) m_stages.size())
+                       + ", chunk " + juce::String((int) k + 1) + "/" + juce::String((int) chunkFiles.size()));
+          }
+
+          try {
+            runStage(s, chunkFiles[k]);
+          } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = e.what();
+          }
+
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            numDone[s] = k + 1;
+          }
+          progressed.notify_all();
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          numStagesFinished++;
+        }
+        // also wakes up the next stage in case we stopped early
+        progressed.notify_all();
+      });
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      progressed.wait(lock, [&] { return numStagesFinished == m_stages.size(); });
+    }
+
+    if (!error.empty()) {
+      cleanup();
+      throw std::runtime_error(error);
+    }
+    if (m_cancelled) {
+      cleanup();
+      return false;
+    }
+
+    // stitch the processed chunks back together
+    std::vector<juce::AudioBuffer<float>> parts(chunkFiles.size());
+    double outSampleRate = 0;
+    for (size_t k = 0; k < chunkFiles.size(); ++k) {
+      double partSampleRate = 0;
+      if (!audioutils::readFile(chunkFiles[k], parts[k], partSampleRate)) {
+        cleanup();
+        throw std::runtime_error("Failed to read a processed chunk of the pipeline.");
+      }
+      if (k == 0) {
+        outSampleRate = partSampleRate;
+      }
+      audioutils::conform(parts[k], partSampleRate, outSampleRate, parts.front().getNumChannels());
+    }
+    cleanup();
+
+    auto joined = audioutils::concatenate(parts, (int) (m_overlapSeconds * outSampleRate));
+    if (!audioutils::writeWav(fileToProcess, joined, outSampleRate)) {
+      throw std::runtime_error("Failed to write the pipeline output to " + fileToProcess.getFullPathName().toStdString());
+    }
+    return true;
+  }
+
+  // stops the pipeline, along with every stage that is running right now
+  void cancel() {
+    std::lock_guard<std::mutex> lock(m_runningMutex);
+    m_cancelled = true;
+    for (const auto& flags : m_running) {
+      flags.cancel.create();
+    }
+  }
+
+private:
+  // every job gets flags of its own, the same model can be in more than one stage
+  // and the model's shared flag would be wiped by whichever of them starts last
+  bool runStage(size_t s, const juce::File& file) {
+    auto flags = JobFlags::makeUnique();
+    {
+      std::lock_guard<std::mutex> lock(m_runningMutex);
+      if (m_cancelled) {
+        return false;
+      }
+      m_running.push_back(flags);
+    }
+
+    auto forget = [this, &flags] {
+      std::lock_guard<std::mutex> lock(m_runningMutex);
+      m_running.erase(std::remove_if(m_running.begin(), m_running.end(),
+                                     [&flags] (const JobFlags& f) { return f.cancel == flags.cancel; }),
+                      m_running.end());
+      flags.cleanup();
+    };
+
+    bool processed = false;
+    try {
+      processed = m_stages[s].model->process(file, *m_stages[s].ctrls, flags);
+    } catch (...) {
+      forget();
+      throw;
+    }
+    forget();
+    return processed;
+  }
+
+  std::vector<PipelineStage> m_stages;
+  double m_chunkSeconds {0};
+  double m_overlapSeconds {0.5};
+  std::atomic<bool> m_cancelled {false};
+  // the flags of the jobs that are running, so cancel() can reach all of them
+  std::mutex m_runningMutex;
+  std::vector<JobFlags> m_running;
+};
@@ -0,0 +1,127 @@
+/**
+ * @file
+ * @brief Processes only a selected range of a file. The range is sent to the
+ * model with some context on either side, and the result is spliced back into
+ * the file at the exact same samples, so the rest of the file is untouched.
+ */
+
+#pragma once
+
+#include "Wave2Wave.h"
+#include "AudioUtils.h"
+
+// a writer for file in format, or nothing if format can't be written (mp3)
+inline std::unique_ptr<juce::AudioFormatWriter> createRegionWriter(juce::AudioFormat* format, const juce::File& file,
+                                                                   double sampleRate, int numChannels, int bitsPerSample,
+                                                                   const juce::StringPairArray& metadata) {
+  std::unique_ptr<juce::OutputStream> stream = file.createOutputStream();
+  if (format == nullptr || stream == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(), sampleRate, (unsigned int) numChannels,
+                                                                          bitsPerSample, metadata, 0));
+  if (writer != nullptr) {
+    stream.release(); // the writer owns the stream now
+  }
+  return writer;
+}
+
+/**
+ * @brief Runs selection (in seconds) of file through model and splices the result back into file.
+ * Only the selection and its padding are decoded, the rest of the file is streamed across
+ * as it is, in the file's own format and bit depth.
+ * @param padding seconds of context sent along on either side of the selection.
+ * Models usually sound better at the edges when they can hear what comes around them.
+ * @param crossfade the longest crossfade (in seconds) at the edges. It is taken from
+ * the padding, so every sample inside the selection comes from the model.
+ * @return the file that holds the result: file itself, or a wav next to it (which replaces
+ * file) if file is in a format that can't be written, such as mp3. an empty file if the
+ * job was cancelled, in which case file is left untouched.
+ * will throw a std::runtime_error if any step fails.
+ */
+inline juce::File processRegion(const Wave2Wave& model, const CtrlList& ctrls, const juce::File& file,
+                                juce::Range<double> selection, double padding, double crossfade) {
+  juce::AudioFormatManager formatManager;
+  formatManager.registerBasicFormats();
+  std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+  if (reader == nullptr) {
+    throw std::runtime_error("Failed to read " + file.getFullPathName().toStdString());
+  }
+
+  const double sampleRate = reader->sampleRate;
+  const int numChannels = (int) reader->numChannels;
+  const auto total = reader->lengthInSamples;
+  const juce::Range<juce::int64> region((juce::int64) std::round(selection.getStart() * sampleRate),
+                                        (juce::int64) std::round(selection.getEnd() * sampleRate));
+  const auto pad = (juce::int64) std::round(padding * sampleRate);
+  const juce::Range<juce::int64> upload(juce::jmax((juce::int64) 0, region.getStart() - pad),
+                                        juce::jmin(total, region.getEnd() + pad));
+  if (region.isEmpty() || upload.isEmpty()) {
+    throw std::runtime_error("The selection is empty.");
+  }
+
+  juce::AudioBuffer<float> excerpt(numChannels, (int) upload.getLength());
+  reader->read(&excerpt, 0, (int) upload.getLength(), upload.getStart(), true, true);
+
+  auto excerptFile = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                         .getChildFile("region_" + juce::Uuid().toString() + ".wav");
+  if (!audioutils::writeWav(excerptFile, excerpt, sampleRate)) {
+    throw std::runtime_error("Failed to write the selection for processing.");
+  }
+
+  bool processedOk = false;
+  try {
+    processedOk = model.process(excerptFile, ctrls);
+  } catch (...) {
+    excerptFile.deleteFile();
+    throw;
+  }
+
+  // a cancelled job leaves the working copy where it was
+  if (!processedOk) {
+    excerptFile.deleteFile();
+    return {};
+  }
+
+  juce::AudioBuffer<float> processed;
+  double processedSampleRate = 0;
+  bool readOk = audioutils::readFile(excerptFile, processed, processedSampleRate);
+  excerptFile.deleteFile();
+  if (!readOk) {
+    throw std::runtime_error("Failed to read the processed selection.");
+  }
+
+  // a model may hand back a different rate or layout, the working copy keeps its own.
+  // the crossfades blend with the padding, which is all in the excerpt.
+  audioutils::conform(processed, processedSampleRate, sampleRate, numChannels);
+  audioutils::splice(excerpt, processed, 0, region - upload.getStart(), (int) std::round(crossfade * sampleRate));
+
+  // write next to the file and swap it in, so a failed write can't corrupt the working copy.
+  // the result keeps the file's format, so it can go straight back to where the file came from
+  auto target = file;
+  auto temp = std::make_unique<juce::TemporaryFile>(target);
+  auto writer = createRegionWriter(formatManager.findFormatForFileExtension(file.getFileExtension()), temp->getFile(),
+                                   sampleRate, numChannels, (int) reader->bitsPerSample, reader->metadataValues);
+  if (writer == nullptr) {
+    // nothing here can encode this format, so the result becomes a wav next to it
+    target = file.withFileExtension("wav");
+    temp = std::make_unique<juce::TemporaryFile>(target);
+    writer = createRegionWriter(formatManager.findFormatForFileExtension("wav"), temp->getFile(),
+                                sampleRate, numChannels, 32, reader->metadataValues);
+  }
+  bool writeOk = writer != nullptr
+                 && writer->writeFromAudioReader(*reader, 0, upload.getStart())
+                 && writer->writeFromAudioSampleBuffer(excerpt, 0, excerpt.getNumSamples())
+                 && writer->writeFromAudioReader(*reader, upload.getEnd(), total - upload.getEnd());
+  // the writer finishes the file when it goes, and the file has to be let go of before it can be replaced
+  writer.reset();
+  reader.reset();
+
+  if (!writeOk || !temp->overwriteTargetFileWithTemporary()) {
+    throw std::runtime_error("Failed to write the processed selection to " + target.getFullPathName().toStdString());
+  }
+  if (target != file) {
+    file.deleteFile();
+  }
+  return target;
+}
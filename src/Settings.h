@@ -0,0 +1,210 @@
+/**
+ * @file
+ * @brief Persistent user settings. Everything is stored in a single
+ * properties file, which can be opened from the Settings menu.
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+
+#include "juce_data_structures/juce_data_structures.h"
+
+// the keys of all settings, with their default values below
+namespace settingkeys {
+  // retries for transient network errors (timeouts, 429s, 5xx)
+  inline constexpr const char* maxRetries = "maxRetries";
+  inline constexpr const char* retryBaseDelay = "retryBaseDelaySeconds";
+  inline constexpr const char* retryMaxDelay = "retryMaxDelaySeconds";
+  // send a duplicate request if a job takes longer than this (0 = off)
+  inline constexpr const char* hedgeAfter = "hedgeAfterSeconds";
+  // where the duplicate request goes (empty = the same space)
+  inline constexpr const char* hedgeUrl = "hedgeUrl";
+  // how long audio uploaded to a space is reused by later jobs with the same audio (0 = always upload)
+  inline constexpr const char* uploadCacheSeconds = "uploadCacheSeconds";
+  // the most jobs that run against one space at once (fewer while it is struggling),
+  // and how many may start per minute (0 = no limit)
+  inline constexpr const char* maxJobsPerSpace = "maxJobsPerSpace";
+  inline constexpr const char* maxJobsPerMinute = "maxJobsPerMinute";
+  // start that upload as soon as a file is opened, instead of when Process is pressed
+  inline constexpr const char* preUpload = "preUpload";
+  // process a short region whenever a control changes (Edit > Live Preview)
+  inline constexpr const char* livePreview = "livePreview";
+  inline constexpr const char* previewSeconds = "previewSeconds";
+  // how long the controls have to stay put before a preview is sent
+  inline constexpr const char* previewDebounceMs = "previewDebounceMs";
+  // context sent along with a selection, and the crossfade used to splice it back
+  inline constexpr const char* regionPadding = "regionPaddingSeconds";
+  inline constexpr const char* regionCrossfade = "regionCrossfadeSeconds";
+  // files larger than this are sent in chunks of chunkSeconds (0 = never). the model
+  // hears each chunk on its own, without the audio around it, so this is opt-in
+  inline constexpr const char* chunkThresholdMB = "chunkThresholdMB";
+  inline constexpr const char* chunkSeconds = "chunkSeconds";
+  // send each channel to a mono model as its own job, instead of a downmix
+  inline constexpr const char* splitChannels = "splitChannels";
+  // only send the parts of a file that are louder than the threshold, each with a margin
+  // of context. silences shorter than silenceMinSeconds are sent along
+  inline constexpr const char* trimSilence = "trimSilence";
+  inline constexpr const char* silenceThresholdDb = "silenceThresholdDb";
+  inline constexpr const char* silenceMinSeconds = "silenceMinSeconds";
+  inline constexpr const char* silenceMargin = "silenceMarginSeconds";
+  // how long a cancelled helper gets to stop its job on the server before it is killed
+  inline constexpr const char* cancelGraceMs = "cancelGraceMs";
+  // how long each stage of a remote job may take before it is cancelled (0 = no limit)
+  inline constexpr const char* connectTimeout = "connectTimeoutSeconds";
+  inline constexpr const char* uploadTimeout = "uploadTimeoutSeconds";
+  inline constexpr const char* queueTimeout = "queueTimeoutSeconds";
+  inline constexpr const char* inferenceTimeout = "inferenceTimeoutSeconds";
+  inline constexpr const char* downloadTimeout = "downloadTimeoutSeconds";
+  // the audio device is released once nothing has played for this long
+  inline constexpr const char* releaseAudioAfter = "releaseAudioDeviceAfterSeconds";
+  // files opened while HARP is running go to the running window, which keeps its model loaded
+  inline constexpr const char* singleInstance = "singleInstance";
+  // the localhost port scripts can drive HARP through (0 = off)
+  inline constexpr const char* controlPort = "controlPort";
+}
+
+struct SettingsStorage {
+  SettingsStorage() {
+    juce::PropertiesFile::Options options;
+    options.applicationName = "HARP";
+    options.folderName = "HARP";
+    options.filenameSuffix = ".settings";
+    options.osxLibrarySubFolder = "Application Support";
+    properties.setStorageParameters(options);
+  }
+
+  /**
+   * @brief The settings, with any edits made to the file since it was last read.
+   * The file is looked at once a second at most, so this is cheap to call often.
+   */
+  juce::PropertiesFile& current() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto now = juce::Time::getMillisecondCounter();
+    if (now - m_lastCheck >= checkIntervalMs) {
+      m_lastCheck = now;
+      reloadIfChanged();
+    }
+    return *properties.getUserSettings();
+  }
+
+  /**
+   * @brief Changes the settings and saves them. Edits made to the file since it was
+   * last read are merged in first, so saving never writes stale values over them.
+   */
+  void update(const std::function<void(juce::PropertiesFile&)>& change) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    reloadIfChanged();
+    auto& file = *properties.getUserSettings();
+    change(file);
+    file.saveIfNeeded();
+    m_lastModified = file.getFile().getLastModificationTime();
+  }
+
+  juce::ApplicationProperties properties;
+
+private:
+  static constexpr juce::uint32 checkIntervalMs = 1000;
+
+  void reloadIfChanged() {
+    auto& file = *properties.getUserSettings();
+    const auto modified = file.getFile().getLastModificationTime();
+    if (modified != m_lastModified) {
+      m_lastModified = modified;
+      file.reload();
+    }
+  }
+
+  std::mutex m_mutex;
+  juce::uint32 m_lastCheck = 0;
+  juce::Time m_lastModified;
+};
+
+/**
+ * @class HARPSettings
+ * @brief Thread safe access to the settings. MainComponent keeps the storage
+ * alive for the lifetime of the app, so these are cheap to call from anywhere.
+ * Edits to the file apply to the next read, except singleInstance and controlPort,
+ * which are only read when HARP starts.
+ */
+class HARPSettings {
+public:
+  static const juce::NamedValueSet& defaults() {
+    static const juce::NamedValueSet values = [] {
+      juce::NamedValueSet v;
+      v.set(settingkeys::maxRetries, 3);
+      v.set(settingkeys::retryBaseDelay, 1.0);
+      v.set(settingkeys::retryMaxDelay, 30.0);
+      v.set(settingkeys::hedgeAfter, 0.0);
+      v.set(settingkeys::hedgeUrl, "");
+      v.set(settingkeys::uploadCacheSeconds, 3600.0);
+      v.set(settingkeys::maxJobsPerSpace, 8);
+      v.set(settingkeys::maxJobsPerMinute, 0.0);
+      v.set(settingkeys::preUpload, false);
+      v.set(settingkeys::livePreview, false);
+      v.set(settingkeys::previewSeconds, 8.0);
+      v.set(settingkeys::previewDebounceMs, 400);
+      v.set(settingkeys::regionPadding, 2.0);
+      v.set(settingkeys::regionCrossfade, 0.05);
+      v.set(settingkeys::chunkThresholdMB, 0);
+      v.set(settingkeys::chunkSeconds, 60.0);
+      v.set(settingkeys::splitChannels, false);
+      v.set(settingkeys::trimSilence, false);
+      v.set(settingkeys::silenceThresholdDb, -60.0);
+      v.set(settingkeys::silenceMinSeconds, 1.0);
+      v.set(settingkeys::silenceMargin, 0.25);
+      v.set(settingkeys::cancelGraceMs, 1500);
+      v.set(settingkeys::connectTimeout, 60.0);
+      v.set(settingkeys::uploadTimeout, 300.0);
+      v.set(settingkeys::queueTimeout, 600.0);
+      v.set(settingkeys::inferenceTimeout, 1800.0);
+      v.set(settingkeys::downloadTimeout, 300.0);
+      v.set(settingkeys::releaseAudioAfter, 10.0);
+      v.set(settingkeys::singleInstance, false);
+      v.set(settingkeys::controlPort, 0);
+      return v;
+    }();
+    return values;
+  }
+
+  static bool getBool(const char* key) {
+    juce::SharedResourcePointer<SettingsStorage> storage;
+    return storage->current().getBoolValue(key, (bool) defaults()[key]);
+  }
+
+  static int getInt(const char* key) {
+    juce::SharedResourcePointer<SettingsStorage> storage;
+    return storage->current().getIntValue(key, (int) defaults()[key]);
+  }
+
+  static double getDouble(const char* key) {
+    juce::SharedResourcePointer<SettingsStorage> storage;
+    return storage->current().getDoubleValue(key, (double) defaults()[key]);
+  }
+
+  static juce::String getString(const char* key) {
+    juce::SharedResourcePointer<SettingsStorage> storage;
+    return storage->current().getValue(key, defaults()[key].toString());
+  }
+
+  static void set(const char* key, const juce::var& value) {
+    juce::SharedResourcePointer<SettingsStorage> storage;
+    storage->update([key, &value] (juce::PropertiesFile& file) {
+      file.setValue(key, value);
+    });
+  }
+
+  // writes any missing keys with their defaults, so the file lists every setting
+  static juce::File writeDefaults() {
+    juce::SharedResourcePointer<SettingsStorage> storage;
+    storage->update([] (juce::PropertiesFile& file) {
+      for (const auto& value : defaults()) {
+        if (!file.containsKey(value.name.toString())) {
+          file.setValue(value.name.toString(), value.value);
+        }
+      }
+    });
+    return storage->properties.getUserSettings()->getFile();
+  }
+};
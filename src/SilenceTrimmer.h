@@ -0,0 +1,208 @@
+/**
+ * @file
+ * @brief Uploads only the parts of a file that aren't silent. A level gate
+ * finds the active spans, which are sent to the model back to back in a
+ * single file (each with a little context around it). The result is cut
+ * apart again and every span goes back to where it came from, so the
+ * silence in between is neither uploaded nor processed.
+ */
+
+#pragma once
+
+#include "juce_dsp/juce_dsp.h"
+
+#include "Wave2Wave.h"
+#include "AudioUtils.h"
+#include "Settings.h"
+
+namespace silence {
+
+  // the gate looks at the level of windows this long
+  constexpr double windowSeconds = 0.02;
+  // not worth cutting up a file when less than this much of it is silent
+  constexpr double minSavedFraction = 0.2;
+
+  inline bool isEnabled() {
+    return HARPSettings::getBool(settingkeys::trimSilence);
+  }
+
+  // the sum of the squares of n samples, a whole register of them at a time
+  inline float sumOfSquares(const float* samples, int n) {
+    using Register = juce::dsp::SIMDRegister<float>;
+    constexpr int lanes = (int) Register::SIMDNumElements;
+
+    float total = 0.0f;
+    int i = 0;
+    // vector loads need an aligned pointer, the samples before that are added one by one
+    for (; i < n && !Register::isSIMDAligned(samples + i); ++i) {
+      total += samples[i] * samples[i];
+    }
+
+    auto sums = Register::expand(0.0f);
+    for (; i + lanes <= n; i += lanes) {
+      auto x = Register::fromRawArray(samples + i);
+      sums += x * x;
+    }
+    total += sums.sum();
+
+    for (; i < n; ++i) {
+      total += samples[i] * samples[i];
+    }
+    return total;
+  }
+
+  /**
+   * @brief Finds the spans of buffer that are louder than thresholdDb (RMS, on any channel).
+   * Spans closer together than minSilenceSeconds are joined, and every span is widened by
+   * marginSeconds on both sides, so the model hears the attack and the tail of each sound.
+   * @return the spans in order, never overlapping. empty if the whole buffer is silent.
+   */
+  inline std::vector<juce::Range<juce::int64>> findActive(const juce::AudioBuffer<float>& buffer, double sampleRate,
+                                                          double thresholdDb, double minSilenceSeconds,
+                                                          double marginSeconds) {
+    const auto total = (juce::int64) buffer.getNumSamples();
+    const int window = juce::jmax(1, (int) (windowSeconds * sampleRate));
+    // compare mean squares, so there's no square root per window
+    const float threshold = juce::square(juce::Decibels::decibelsToGain((float) thresholdDb, -200.0f));
+    const auto minSilence = (juce::int64) (minSilenceSeconds * sampleRate);
+    const auto margin = (juce::int64) (marginSeconds * sampleRate);
+
+    std::vector<juce::Range<juce::int64>> active;
+    for (juce::int64 start = 0; start < total; start += window) {
+      const int length = (int) juce::jmin((juce::int64) window, total - start);
+      bool loud = false;
+      for (int ch = 0; ch < buffer.getNumChannels() && !loud; ++ch) {
+        loud = sumOfSquares(buffer.getReadPointer(ch, (int) start), length) / (float) length > threshold;
+      }
+      if (!loud) {
+        continue;
+      }
+
+      const juce::Range<juce::int64> span(start, start + length);
+      if (!active.empty() && span.getStart() - active.back().getEnd() < minSilence) {
+        active.back() = active.back().getUnionWith(span);
+      } else {
+        active.push_back(span);
+      }
+    }
+
+    // widening can make neighbours overlap, those become one span
+    std::vector<juce::Range<juce::int64>> spans;
+    for (const auto& span : active) {
+      const juce::Range<juce::int64> padded(juce::jmax((juce::int64) 0, span.getStart() - margin),
+                                            juce::jmin(total, span.getEnd() + margin));
+      if (!spans.empty() && padded.getStart() <= spans.back().getEnd()) {
+        spans.back() = spans.back().getUnionWith(padded);
+      } else {
+        spans.push_back(padded);
+      }
+    }
+    return spans;
+  }
+
+  /**
+   * @brief Processes file in place, sending only the spans that aren't silent.
+   * Files that are mostly sound are processed whole, as usual. The model has to give
+   * back as much audio as it was sent, at any rate or channel count.
+   * @param onProgress called from the calling thread with short status messages.
+   * @return false if the job was cancelled, in which case file is left untouched.
+   * will throw a std::runtime_error if any step fails.
+   */
+  inline bool processActive(const Wave2Wave& model, const CtrlList& ctrls, const juce::File& file,
+                            std::function<void(const juce::String&)> onProgress = nullptr) {
+    juce::AudioBuffer<float> original;
+    double sampleRate = 0;
+    if (!audioutils::readFile(file, original, sampleRate)) {
+      throw std::runtime_error("Failed to read " + file.getFullPathName().toStdString());
+    }
+
+    const auto margin = HARPSettings::getDouble(settingkeys::silenceMargin);
+    const auto spans = findActive(original, sampleRate,
+                                  HARPSettings::getDouble(settingkeys::silenceThresholdDb),
+                                  HARPSettings::getDouble(settingkeys::silenceMinSeconds), margin);
+
+    juce::int64 activeLength = 0;
+    for (const auto& span : spans) {
+      activeLength += span.getLength();
+    }
+    if (spans.empty()) {
+      // a silent file stays silent, there is nothing to send
+      if (onProgress) {
+        onProgress("Nothing above the silence gate, the file was not sent");
+      }
+      return true;
+    }
+    if (activeLength > (juce::int64) ((1.0 - minSavedFraction) * original.getNumSamples())) {
+      return model.process(file, ctrls);
+    }
+
+    if (onProgress) {
+      onProgress("Sending " + juce::String((int) spans.size()) + " non-silent parts ("
+                 + juce::String(100.0 * (double) activeLength / original.getNumSamples(), 0) + "% of the file)");
+    }
+
+    juce::AudioBuffer<float> packed(original.getNumChannels(), (int) activeLength);
+    juce::int64 offset = 0;
+    for (const auto& span : spans) {
+      for (int ch = 0; ch < original.getNumChannels(); ++ch) {
+        packed.copyFrom(ch, (int) offset, original, ch, (int) span.getStart(), (int) span.getLength());
+      }
+      offset += span.getLength();
+    }
+
+    auto packedFile = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                          .getChildFile("active_" + juce::Uuid().toString() + ".wav");
+    if (!audioutils::writeWav(packedFile, packed, sampleRate)) {
+      throw std::runtime_error("Failed to write the non-silent parts for processing.");
+    }
+
+    bool processedOk = false;
+    try {
+      processedOk = model.process(packedFile, ctrls);
+    } catch (...) {
+      packedFile.deleteFile();
+      throw;
+    }
+    if (!processedOk) {
+      packedFile.deleteFile();
+      return false;
+    }
+
+    juce::AudioBuffer<float> processed;
+    double processedSampleRate = 0;
+    bool readOk = audioutils::readFile(packedFile, processed, processedSampleRate);
+    packedFile.deleteFile();
+    if (!readOk) {
+      throw std::runtime_error("Failed to read the processed parts.");
+    }
+    audioutils::conform(processed, processedSampleRate, sampleRate, original.getNumChannels());
+    if (std::abs(processed.getNumSamples() - packed.getNumSamples()) > (int) (windowSeconds * sampleRate)) {
+      throw std::runtime_error("The model changed the length of the audio, so the parts can't be put back. "
+                               "Turn off trimSilence in the settings for this model.");
+    }
+
+    // the edges of each part fade into the silence around it
+    const int fade = (int) juce::jmin(0.05 * sampleRate, 0.5 * margin * sampleRate);
+    offset = 0;
+    for (const auto& span : spans) {
+      const auto length = juce::jmin(span.getLength(), (juce::int64) processed.getNumSamples() - offset);
+      if (length <= 0) {
+        break;
+      }
+      juce::AudioBuffer<float> part(processed.getNumChannels(), (int) length);
+      for (int ch = 0; ch < processed.getNumChannels(); ++ch) {
+        part.copyFrom(ch, 0, processed, ch, (int) offset, (int) length);
+      }
+      const juce::Range<juce::int64> inner(span.getStart() + fade, span.getStart() + length - fade);
+      audioutils::splice(original, part, span.getStart(), inner.isEmpty() ? span : inner, fade);
+      offset += span.getLength();
+    }
+
+    // write next to the file and swap it in, so a failed write can't corrupt the working copy
+    juce::TemporaryFile temp(file);
+    if (!audioutils::writeWav(temp.getFile(), original, sampleRate) || !temp.overwriteTargetFileWithTemporary()) {
+      throw std::runtime_error("Failed to write the processed parts to " + file.getFullPathName().toStdString());
+    }
+    return true;
+  }
+}
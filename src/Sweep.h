@@ -0,0 +1,247 @@
+/**
+ * @file
+ * @brief Parameter sweeps: a list of values for some of a model's controls,
+ * expanded into every combination of them. Each combination becomes its own
+ * control snapshot, so the whole grid can be processed at once.
+ */
+
+#pragma once
+
+#include <set>
+
+#include "CtrlStore.h"
+
+// the values one control takes in a sweep
+struct SweepAxis {
+  juce::Uuid id;
+  juce::String label;
+  juce::Array<juce::var> values;
+};
+
+// one combination of the grid, ready to be handed to a job
+struct SweepPoint {
+  CtrlSnapshot ctrls;
+  // e.g. "pitch=2, mode=fast"
+  juce::String label;
+};
+
+namespace sweep {
+
+  // every combination is a job of its own, more than this is almost certainly a typo
+  constexpr size_t maxGridSize = 256;
+
+  inline bool isSweepable(const Ctrl& ctrl) {
+    return dynamic_cast<const SliderCtrl*>(&ctrl) != nullptr
+           || dynamic_cast<const NumberBoxCtrl*>(&ctrl) != nullptr
+           || dynamic_cast<const ToggleCtrl*>(&ctrl) != nullptr
+           || dynamic_cast<const ComboBoxCtrl*>(&ctrl) != nullptr;
+  }
+
+  // a short hint of what parseValues() accepts for ctrl
+  inline juce::String describeSyntax(const Ctrl& ctrl) {
+    if (dynamic_cast<const ToggleCtrl*>(&ctrl)) {
+      return "on, off or both";
+    }
+    if (dynamic_cast<const ComboBoxCtrl*>(&ctrl)) {
+      return "option, option, ... or * for all";
+    }
+    return "start:end:count or a, b, c";
+  }
+
+  /**
+   * @brief Turns the text typed for ctrl into the values it takes in the sweep.
+   * Numbers take "start:end:count" (evenly spaced, both ends included) or a comma
+   * separated list, and are clamped to the control's range. Toggles take "on",
+   * "off" or "both", dropdowns take a list of options or "*" for all of them.
+   * A control never takes more than maxGridSize values.
+   * @return no values for an empty spec. will throw a std::runtime_error if spec can't be parsed.
+   */
+  inline juce::Array<juce::var> parseValues(const Ctrl& ctrl, const juce::String& spec) {
+    juce::Array<juce::var> values;
+    auto text = spec.trim();
+    if (text.isEmpty()) {
+      return values;
+    }
+
+    auto fail = [&ctrl, &text](const juce::String& why) {
+      throw std::runtime_error(("Can't sweep " + juce::String(ctrl.label) + " over \"" + text + "\": " + why).toStdString());
+    };
+
+    if (dynamic_cast<const ToggleCtrl*>(&ctrl)) {
+      if (text.equalsIgnoreCase("both")) {
+        values.add(false);
+        values.add(true);
+      } else if (text.equalsIgnoreCase("on") || text.equalsIgnoreCase("true")) {
+        values.add(true);
+      } else if (text.equalsIgnoreCase("off") || text.equalsIgnoreCase("false")) {
+        values.add(false);
+      } else {
+        fail("expected on, off or both");
+      }
+      return values;
+    }
+
+    if (auto comboBox = dynamic_cast<const ComboBoxCtrl*>(&ctrl)) {
+      if (text == "*") {
+        for (const auto& option : comboBox->options) {
+          values.add(juce::String(option));
+        }
+        return values;
+      }
+      for (auto option : juce::StringArray::fromTokens(text, ",", "\"")) {
+        option = option.trim().unquoted();
+        if (std::find(comboBox->options.begin(), comboBox->options.end(), option.toStdString()) == comboBox->options.end()) {
+          fail(option + " is not one of the options");
+        }
+        values.add(option);
+      }
+      return values;
+    }
+
+    double minimum = 0, maximum = 0;
+    if (auto slider = dynamic_cast<const SliderCtrl*>(&ctrl)) {
+      minimum = slider->minimum;
+      maximum = slider->maximum;
+    } else if (auto numberBox = dynamic_cast<const NumberBoxCtrl*>(&ctrl)) {
+      minimum = numberBox->min;
+      maximum = numberBox->max;
+    } else {
+      fail("this type of control can't be swept");
+    }
+
+    // values clamped to the range often land on the same number, which is only swept once
+    std::set<double> seen;
+    auto addNumber = [] (juce::Array<juce::var>& into, std::set<double>& already, double value) {
+      if (already.insert(value).second) {
+        into.add(value);
+      }
+    };
+
+    auto isNumber = [] (const juce::String& s) {
+      return s.trim().isNotEmpty() && s.trim().containsOnly("0123456789.-+eE");
+    };
+
+    if (text.contains(":")) {
+      auto parts = juce::StringArray::fromTokens(text, ":", "");
+      if (parts.size() != 3 || !isNumber(parts[0]) || !isNumber(parts[1]) || !isNumber(parts[2])) {
+        fail("expected start:end:count");
+      }
+      auto start = parts[0].getDoubleValue();
+      auto end = parts[1].getDoubleValue();
+      auto count = parts[2].getLargeIntValue();
+      if (count < 1) {
+        fail("count must be at least 1");
+      }
+      if (count > (juce::int64) maxGridSize) {
+        fail("count can be at most " + juce::String((int) maxGridSize));
+      }
+      for (int i = 0; i < (int) count; ++i) {
+        auto value = count == 1 ? start : start + (end - start) * i / (double) (count - 1);
+        addNumber(values, seen, juce::jlimit(minimum, maximum, value));
+      }
+      return values;
+    }
+
+    auto items = juce::StringArray::fromTokens(text, ",", "");
+    if (items.size() > (int) maxGridSize) {
+      fail("at most " + juce::String((int) maxGridSize) + " values");
+    }
+    for (const auto& item : items) {
+      if (!isNumber(item)) {
+        fail(item.trim() + " is not a number");
+      }
+      addNumber(values, seen, juce::jlimit(minimum, maximum, item.getDoubleValue()));
+    }
+    return values;
+  }
+
+  // a copy of ctrl with its value replaced
+  inline std::shared_ptr<const Ctrl> withValue(const Ctrl& ctrl, const juce::var& value) {
+    if (auto slider = dynamic_cast<const SliderCtrl*>(&ctrl)) {
+      auto copy = std::make_shared<SliderCtrl>(*slider);
+      copy->value = (double) value;
+      return copy;
+    }
+    if (auto numberBox = dynamic_cast<const NumberBoxCtrl*>(&ctrl)) {
+      auto copy = std::make_shared<NumberBoxCtrl>(*numberBox);
+      copy->value = (double) value;
+      return copy;
+    }
+    if (auto toggle = dynamic_cast<const ToggleCtrl*>(&ctrl)) {
+      auto copy = std::make_shared<ToggleCtrl>(*toggle);
+      copy->value = (bool) value;
+      return copy;
+    }
+    if (auto comboBox = dynamic_cast<const ComboBoxCtrl*>(&ctrl)) {
+      auto copy = std::make_shared<ComboBoxCtrl>(*comboBox);
+      copy->value = value.toString().toStdString();
+      return copy;
+    }
+    return nullptr;
+  }
+
+  inline juce::String formatValue(const juce::var& value) {
+    if (value.isBool()) {
+      return (bool) value ? "on" : "off";
+    }
+    if (value.isDouble()) {
+      return juce::String((double) value, 3).trimCharactersAtEnd("0").trimCharactersAtEnd(".");
+    }
+    return value.toString();
+  }
+
+  // the number of combinations, which stops counting just past maxGridSize so it can't overflow
+  inline size_t gridSize(const std::vector<SweepAxis>& axes) {
+    if (axes.empty()) {
+      return 0;
+    }
+    size_t size = 1;
+    for (const auto& axis : axes) {
+      size = juce::jmin(maxGridSize + 1, size * (size_t) axis.values.size());
+    }
+    return size;
+  }
+
+  /**
+   * @brief Expands axes into every combination of their values, on top of base.
+   * Controls that are not part of any axis keep their value from base.
+   * The first axis changes slowest, so results come out grouped by it.
+   * @return nothing if there are no axes, or more than maxGridSize combinations.
+   */
+  inline std::vector<SweepPoint> makeGrid(const CtrlSnapshot& base, const std::vector<SweepAxis>& axes) {
+    std::vector<SweepPoint> grid;
+    const auto size = gridSize(axes);
+    if (size == 0 || size > maxGridSize) {
+      return grid;
+    }
+    grid.reserve(size);
+
+    std::vector<int> position(axes.size(), 0);
+    while (true) {
+      auto ctrls = std::make_shared<CtrlList>(*base);
+      juce::StringArray parts;
+
+      for (size_t a = 0; a < axes.size(); ++a) {
+        const auto& value = axes[a].values.getReference(position[a]);
+        for (auto& pair : *ctrls) {
+          if (pair.first == axes[a].id) {
+            pair.second = withValue(*pair.second, value);
+          }
+        }
+        parts.add(axes[a].label + "=" + formatValue(value));
+      }
+      grid.push_back({ctrls, parts.joinIntoString(", ")});
+
+      // count up like an odometer, the last axis moving fastest
+      int a = (int) axes.size() - 1;
+      while (a >= 0 && ++position[(size_t) a] == axes[(size_t) a].values.size()) {
+        position[(size_t) a] = 0;
+        --a;
+      }
+      if (a < 0) {
+        break;
+      }
+    }
+    return grid;
+  }
+}
@@ -64,15 +64,23 @@ class JobProcessorThread : public Thread {
   private:
 
     void executeTask() {
+      // idle workers still wake up every half second, so they only live as long as a batch
+      // how many of them talk to a space at once is up to its AdaptiveLimiter, so
+      // the pool only needs to be big enough that a job waiting for one space
+      // doesn't hold up the jobs for another
+      if (threadPool == nullptr) {
+        threadPool = std::make_unique<ThreadPool>(jlimit(1, 64, (int) customJobs.size()));
+      }
       for (auto& customJob : customJobs) {
-            threadPool.addJob(customJob, true); // The pool will take ownership and delete the job when finished
+            threadPool->addJob(customJob, true); // The pool will take ownership and delete the job when finished
             // customJob->runJob();
         }
 
         // Wait for all jobs to finish
         for (auto& customJob : customJobs) {
-            threadPool.waitForJobToFinish(customJob, -1); // -1 for no timeout
+            threadPool->waitForJobToFinish(customJob, -1); // -1 for no timeout
         }
+        threadPool.reset();
 
         // This will run after all jobs are done
         // if (jobsFinished == totalJobs) {
@@ -87,7 +95,7 @@ class JobProcessorThread : public Thread {
     int& totalJobs;
     
     // ThreadPool for processing jobs (not loading)
-    ThreadPool threadPool {10};
+    std::unique_ptr<ThreadPool> threadPool;
     ChangeBroadcaster& processBroadcaster;
     WaitableEvent signalEvent;
 };
\ No newline at end of file
@@ -0,0 +1,356 @@
+/**
+ * @file
+ * @brief A versioned history of the working copy. Every version is split into
+ * content-defined chunks that live in a deduplicated block store, so keeping
+ * many versions of a large file only costs the bytes that actually changed.
+ */
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "juce_core/juce_core.h"
+#include "juce_cryptography/juce_cryptography.h"
+#include "juce_events/juce_events.h"
+
+namespace cdc {
+  // chunks are never smaller than this (except for the tail of a file)...
+  constexpr size_t minChunkSize = 16 * 1024;
+  // ...and never larger than this
+  constexpr size_t maxChunkSize = 256 * 1024;
+  // 16 bits of the rolling hash must be zero for a cut, ~64KiB past the minimum on average.
+  // we use the high bits since they depend on the most bytes of the window.
+  constexpr juce::uint64 boundaryMask = 0xFFFFull << 48;
+
+  // random table for the gear rolling hash (splitmix64, so it is stable across runs)
+  inline const std::array<juce::uint64, 256>& gearTable() {
+    static const auto table = [] {
+      std::array<juce::uint64, 256> t {};
+      juce::uint64 x = 0;
+      for (auto& v : t) {
+        x += 0x9E3779B97F4A7C15ull;
+        juce::uint64 z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        v = z ^ (z >> 31);
+      }
+      return t;
+    }();
+    return table;
+  }
+
+  // returns the length of the chunk that starts at data.
+  // cut points only depend on the bytes around them, so an edit in one
+  // part of a file leaves the chunks of the rest of the file untouched.
+  inline size_t nextChunkLength(const juce::uint8* data, size_t size) {
+    if (size <= minChunkSize) {
+      return size;
+    }
+
+    const auto& gear = gearTable();
+    const size_t limit = std::min(size, maxChunkSize);
+    juce::uint64 hash = 0;
+    for (size_t i = minChunkSize; i < limit; ++i) {
+      hash = (hash << 1) + gear[data[i]];
+      if ((hash & boundaryMask) == 0) {
+        return i + 1;
+      }
+    }
+    return limit;
+  }
+}
+
+
+/**
+ * @class VersionHistory
+ * @brief Linear undo/redo history of a file, backed by a deduplicated block store.
+ */
+class VersionHistory {
+public:
+  ~VersionHistory() {
+    waitForCommits();
+  }
+
+  /**
+   * @brief The store for the history of target inside parent. It is keyed by the full path of
+   * target and by this history, so two files with the same name, or two windows, never share one.
+   */
+  juce::File storeDirFor(const juce::File& parent, const juce::File& target) const {
+    auto key = juce::SHA256(target.getFullPathName().toUTF8()).toHexString().substring(0, 16);
+    return parent.getChildFile(key + "_" + m_session);
+  }
+
+  /**
+   * @brief Drops all versions and (re)creates an empty store in storeDir.
+   */
+  void reset(const juce::File& storeDir) {
+    clear();
+    m_dir = storeDir;
+    // only a store this history made itself is ever deleted again
+    m_ownsDir = !m_dir.exists();
+    m_dir.getChildFile("blocks").createDirectory();
+  }
+
+  /**
+   * @brief Deletes every version along with the block store on disk, once pending commits are done.
+   */
+  void clear() {
+    waitForCommits();
+    if (m_dir != juce::File() && m_ownsDir) {
+      m_dir.deleteRecursively();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_versions.clear();
+    m_current = -1;
+  }
+
+  /**
+   * @brief Adds the current contents of file as a new version after the current one, on a
+   * background thread. Commits are made one at a time, in order. file must not change until
+   * waitForCommits() returns. Any versions that could have been redone are discarded, along
+   * with the blocks no other version uses.
+   * @param onDone called on the message thread with false if the version could not be stored.
+   */
+  void commit(const juce::File& file, const juce::String& label, std::function<void(bool)> onDone = nullptr) {
+    if (m_pool == nullptr) {
+      m_pool = std::make_unique<juce::ThreadPool>(1);
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      ++m_pending;
+    }
+
+    juce::WeakReference<VersionHistory> weakThis(this);
+    m_pool->addJob([this, weakThis, file, label, onDone] {
+      const bool ok = commitNow(file, label);
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_pending;
+      }
+      m_committed.notify_all();
+
+      juce::MessageManager::callAsync([weakThis, ok, onDone] {
+        auto* self = weakThis.get();
+        if (self == nullptr) {
+          return;
+        }
+        self->releasePoolIfIdle();
+        if (onDone) {
+          onDone(ok);
+        }
+      });
+    });
+  }
+
+  // blocks until every commit made so far is in the history
+  void waitForCommits() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_committed.wait(lock, [this] { return m_pending == 0; });
+  }
+
+  bool canUndo() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_current > 0;
+  }
+
+  bool canRedo() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_current >= 0 && m_current < (int) m_versions.size() - 1;
+  }
+
+  /**
+   * @brief Reassembles version index from the block store and atomically replaces target with it.
+   */
+  bool restore(int index, const juce::File& target) {
+    juce::StringArray blocks;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (index < 0 || index >= (int) m_versions.size()) {
+        return false;
+      }
+      blocks = m_versions[(size_t) index].blocks;
+    }
+
+    juce::TemporaryFile temp(target);
+    {
+      auto out = temp.getFile().createOutputStream();
+      if (out == nullptr) {
+        DBG("VersionHistory::restore: failed to create " << temp.getFile().getFullPathName());
+        return false;
+      }
+
+      for (const auto& hash : blocks) {
+        juce::FileInputStream block(blockFile(hash));
+        if (!block.openedOk() || out->writeFromInputStream(block, -1) != block.getTotalLength()) {
+          DBG("VersionHistory::restore: missing or unreadable block " << hash);
+          return false;
+        }
+      }
+      out->flush();
+    }
+
+    if (!temp.overwriteTargetFileWithTemporary()) {
+      DBG("VersionHistory::restore: failed to replace " << target.getFullPathName());
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_current = index;
+    return true;
+  }
+
+  int getNumVersions() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (int) m_versions.size();
+  }
+
+  int getCurrentIndex() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_current;
+  }
+
+  juce::String getLabel(int index) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (index < 0 || index >= (int) m_versions.size()) {
+      return {};
+    }
+    return m_versions[(size_t) index].label;
+  }
+
+private:
+  struct Version {
+    juce::StringArray blocks;
+    juce::String label;
+  };
+
+  bool commitNow(const juce::File& file, const juce::String& label) {
+    if (m_dir == juce::File()) {
+      DBG("VersionHistory::commit: no store directory set");
+      return false;
+    }
+
+    juce::FileInputStream in(file);
+    if (!in.openedOk()) {
+      DBG("VersionHistory::commit: failed to open " << file.getFullPathName());
+      return false;
+    }
+
+    Version version;
+    version.label = label;
+
+    // a window of two max chunks, so there is always a full chunk to cut from
+    std::vector<juce::uint8> window(cdc::maxChunkSize * 2);
+    size_t filled = 0;
+    bool eof = false;
+
+    while (true) {
+      while (!eof && filled < cdc::maxChunkSize) {
+        auto numRead = in.read(window.data() + filled, (int) (window.size() - filled));
+        if (numRead <= 0) {
+          eof = true;
+        } else {
+          filled += (size_t) numRead;
+        }
+      }
+
+      if (filled == 0) {
+        break;
+      }
+
+      auto length = cdc::nextChunkLength(window.data(), filled);
+      auto hash = juce::SHA256(window.data(), length).toHexString();
+
+      if (!writeBlock(hash, window.data(), length)) {
+        return false;
+      }
+      version.blocks.add(hash);
+
+      std::memmove(window.data(), window.data() + length, filled - length);
+      filled -= length;
+    }
+
+    std::vector<juce::String> unused;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      // nothing changed, no need for a new version
+      if (m_current >= 0 && m_versions[(size_t) m_current].blocks == version.blocks) {
+        return true;
+      }
+
+      std::set<juce::String> discarded;
+      for (size_t i = (size_t) (m_current + 1); i < m_versions.size(); ++i) {
+        discarded.insert(m_versions[i].blocks.begin(), m_versions[i].blocks.end());
+      }
+      m_versions.resize((size_t) (m_current + 1));
+      m_versions.push_back(std::move(version));
+      m_current = (int) m_versions.size() - 1;
+
+      if (!discarded.empty()) {
+        for (const auto& kept : m_versions) {
+          for (const auto& hash : kept.blocks) {
+            discarded.erase(hash);
+          }
+        }
+        unused.assign(discarded.begin(), discarded.end());
+      }
+    }
+
+    // only this thread writes blocks, so none of these can be picked up again meanwhile
+    for (const auto& hash : unused) {
+      blockFile(hash).deleteFile();
+    }
+    return true;
+  }
+
+  juce::File blockFile(const juce::String& hash) const {
+    // fan out into subdirectories so no single directory gets huge
+    return m_dir.getChildFile("blocks").getChildFile(hash.substring(0, 2)).getChildFile(hash);
+  }
+
+  bool writeBlock(const juce::String& hash, const void* data, size_t size) {
+    auto file = blockFile(hash);
+    if (file.existsAsFile()) {
+      return true; // already stored by an earlier version
+    }
+
+    file.getParentDirectory().createDirectory();
+    // write to a sibling and rename, so a crash never leaves a truncated block behind
+    auto partial = file.withFileExtension("part");
+    if (!partial.replaceWithData(data, size) || !partial.moveFileTo(file)) {
+      DBG("VersionHistory::writeBlock: failed to write block " << hash);
+      partial.deleteFile();
+      return false;
+    }
+
+    return true;
+  }
+
+  // idle workers still wake up every half second, so the pool is dropped between commits
+  void releasePoolIfIdle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_pool != nullptr && m_pending == 0) {
+      lock.unlock();
+      m_pool.reset();
+    }
+  }
+
+  const juce::String m_session {juce::Uuid().toString().substring(0, 8)};
+  juce::File m_dir;
+  bool m_ownsDir {false};
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_committed;
+  std::vector<Version> m_versions;
+  int m_current {-1};
+  int m_pending {0};
+
+  JUCE_DECLARE_WEAK_REFERENCEABLE(VersionHistory)
+
+  // declared last, so its thread is gone before anything it uses
+  std::unique_ptr<juce::ThreadPool> m_pool;
+};
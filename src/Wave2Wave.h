@@ -0,0 +1,580 @@
+/**
+ * @file
+ * @brief Base class for models that take an audio file and give back a new
+ * one. Where the model runs is up to the subclass (a gradio space, or an
+ * exported graph running inside HARP), but every backend describes its
+ * controls and model card with the same json spec, and reports its status
+ * and gets cancelled through the same flag files.
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Model.h"
+#include "CtrlStore.h"
+#include "Diagnostics.h"
+#include "AudioUtils.h"
+#include "Settings.h"
+
+#include "juce_core/juce_core.h"
+
+
+// the flag files one helper invocation uses to talk to HARP. jobs that need to
+// be cancelled on their own, without touching the model's main job (e.g. live
+// previews), get a fresh pair from makeUnique().
+struct JobFlags {
+  juce::File cancel;
+  juce::File status;
+
+  static JobFlags makeUnique() {
+    auto id = juce::Uuid().toString();
+    auto tempDir = juce::File::getSpecialLocation(juce::File::tempDirectory);
+    return {tempDir.getChildFile("harpjob_CANCEL_" + id), tempDir.getChildFile("harpjob_STATUS_" + id)};
+  }
+
+  void cleanup() const {
+    cancel.deleteFile();
+    status.deleteFile();
+  }
+};
+
+
+class Wave2Wave : public Model {
+public:
+  virtual ~Wave2Wave() {
+    // clean up flag files
+    m_cancel_flag_file.deleteFile();
+    m_status_flag_file.deleteFile();
+  }
+
+  bool ready() const override { return m_loaded; }
+
+  // where the model was loaded from (a space url, or a file), for display and caching
+  virtual std::string space_url() const = 0;
+
+  void LogAndDBG(const juce::String& message) const {
+    DBG(message);
+    logger().logMessage(message);
+  }
+
+  juce::File getLogFile() const {
+    return logger().getLogFile();
+  }
+
+  // the current control values. jobs should take this once, when they are submitted
+  CtrlSnapshot controls() const {
+    return m_ctrls.snapshot();
+  }
+
+  // where the UI edits the control values
+  CtrlStore& ctrlStore() {
+    return m_ctrls;
+  }
+
+  // the control values as a json list, in the order of the controls.
+  // returns an empty string if one of the controls can't be sent.
+  juce::String ctrlsToJson(const CtrlList& ctrls, std::string audioInputPath) const {
+    // Create a JSON array to hold each control's value
+    juce::Array<juce::var> jsonCtrlsArray;
+
+    // Iterate through each control
+    for (const auto& ctrlPair : ctrls) {
+        auto ctrl = ctrlPair.second;
+
+        // Check the type of ctrl and extract its value
+        if (auto sliderCtrl = dynamic_cast<const SliderCtrl*>(ctrl.get())) {
+            // Slider control, use sliderCtrl->value
+            jsonCtrlsArray.add(juce::var(sliderCtrl->value));
+        } else if (auto textBoxCtrl = dynamic_cast<const TextBoxCtrl*>(ctrl.get())) {
+            // Text box control, use textBoxCtrl->value
+            jsonCtrlsArray.add(juce::var(textBoxCtrl->value));
+        } else if (auto numberBoxCtrl = dynamic_cast<const NumberBoxCtrl*>(ctrl.get())) {
+            // Number box control, use numberBoxCtrl->value
+            jsonCtrlsArray.add(juce::var(numberBoxCtrl->value));
+        } else if (auto toggleCtrl = dynamic_cast<const ToggleCtrl*>(ctrl.get())) {
+            // Toggle control, use toggleCtrl->value
+            jsonCtrlsArray.add(juce::var(toggleCtrl->value));
+        } else if (auto comboBoxCtrl = dynamic_cast<const ComboBoxCtrl*>(ctrl.get())) {
+            // Combo box control, use comboBoxCtrl->value
+            jsonCtrlsArray.add(juce::var(comboBoxCtrl->value));
+        } else if (dynamic_cast<const AudioInCtrl*>(ctrl.get())) {
+            // Audio in control, always the file of this job
+            // (the snapshot is shared with other jobs, so it is not written to)
+            jsonCtrlsArray.add(juce::var(audioInputPath));
+        } else {
+            // Unsupported control type or missing implementation
+            LogAndDBG("Unsupported control type or missing implementation for control with ID: " + ctrl->id.toString());
+            return {};
+        }
+    }
+
+    // Convert the array to a JSON string
+    return juce::JSON::toString(jsonCtrlsArray, true);  // true for human-readable
+  }
+
+  bool process(juce::File filetoProcess) const {
+    return process(filetoProcess, *m_ctrls.snapshot());
+  }
+
+  // processes filetoProcess in place, using the given control values
+  // instead of the ones currently shown in the UI.
+  // returns false if the job was cancelled and the file was left untouched.
+  // will throw a std::runtime_error if processing fails.
+  bool process(juce::File filetoProcess, const CtrlList& ctrls) const {
+    return process(filetoProcess, ctrls, sharedJobFlags());
+  }
+
+  // the model's own flag files, with the cancel flag cleared. a job that is made of
+  // several process calls takes these once, so a cancel between two calls sticks.
+  JobFlags sharedJobFlags() const {
+    m_cancel_flag_file.deleteFile();
+    return {m_cancel_flag_file, m_status_flag_file};
+  }
+
+  // same as above, but the job is cancelled (and reports its status) through
+  // flags instead of the model's own flag files
+  virtual bool process(juce::File filetoProcess, const CtrlList& ctrls, const JobFlags& flags) const = 0;
+
+  // sets a cancel flag file that the running job checks to see if it
+  // should be cancelled
+  void cancel() {
+    m_cancel_flag_file.deleteFile();
+    m_cancel_flag_file.create();
+  }
+
+  std::string getStatus() {
+    // nothing has written a status yet
+    if (!m_status_flag_file.exists()) {
+      return "Status.INITIALIZED";
+    }
+
+    // read the status file and return its text
+    juce::String status = m_status_flag_file.loadFileAsString();
+    return status.toStdString();
+  }
+
+  // the status, along with anything the backend knows about the progress of the job
+  virtual std::string getStatusMessage() {
+    return getStatus();
+  }
+
+  juce::File getCancelFlagFile() const {
+    return m_cancel_flag_file;
+  }
+
+protected:
+  /**
+   * @brief Fills the model card and the controls from a spec of the form
+   * {"card": {"name", "description", "author", "tags"}, "ctrls": [{"ctrl_type", "label", ...}]},
+   * which is what the helper's get_ctrls returns for a space.
+   * will throw a std::runtime_error if the spec is malformed.
+   */
+  void loadSpec(const juce::var& controls) {
+    CtrlList ctrls;
+
+    juce::DynamicObject *ctrlDict = controls.getDynamicObject();
+    if (ctrlDict == nullptr) {
+        throw std::runtime_error("Failed to load control dict from JSON. ctrlDict is null.");
+    }
+
+    // the "ctrls" key should be a list of dicts
+    // the "card" key should be the modelcard
+
+    // BEGIN  MODELCARD
+    if (!ctrlDict->hasProperty("card")) {
+        throw std::runtime_error("Failed to load model card from JSON. card key not found.");
+    }
+    juce::DynamicObject *jsonCard = ctrlDict->getProperty("card").getDynamicObject();
+    if (jsonCard == nullptr) {
+        throw std::runtime_error("Failed to load model card from JSON.");
+    }
+
+    // TODO: probably need to check if these properties exist and if they're the right types.
+    m_card = ModelCard();
+    m_card.name = jsonCard->getProperty("name").toString().toStdString();
+    m_card.description = jsonCard->getProperty("description").toString().toStdString();
+    m_card.author = jsonCard->getProperty("author").toString().toStdString();
+    // only set by models that need their input at a particular rate (0 = any)
+    m_card.sampleRate = (int) jsonCard->getProperty("sample_rate");
+    // "channels" is a count, or a list of the counts the model takes
+    auto channels = jsonCard->getProperty("channels");
+    if (auto* counts = channels.getArray()) {
+      for (const auto& count : *counts) {
+        m_card.channels.push_back((int) count);
+      }
+    } else if ((int) channels > 0) {
+      m_card.channels.push_back((int) channels);
+    }
+
+    // tags is a list of str
+    juce::Array<juce::var> *tags = jsonCard->getProperty("tags").getArray();
+    if (tags == nullptr) {
+        throw std::runtime_error("Failed to load tags from JSON. tags is null.");
+    }
+    for (int i = 0; i < tags->size(); i++) {
+      m_card.tags.push_back(tags->getReference(i).toString().toStdString());
+    }
+    // END MODELCARD
+
+    if (!ctrlDict->hasProperty("ctrls")) {
+        throw std::runtime_error("Failed to load controls from JSON. ctrls key not found.");
+    }
+    // else, it should be a list of dicts
+    juce::Array<juce::var> *ctrlList = ctrlDict->getProperty("ctrls").getArray();
+    if (ctrlList == nullptr) {
+        throw std::runtime_error("Failed to load controls from JSON. ctrlList is null.");
+    }
+
+    // iterate through the list of controls
+    // and add them to the ctrls vector
+    for (int i = 0; i < ctrlList->size(); i++) {
+      juce::var ctrl = ctrlList->getReference(i);
+      if (!ctrl.isObject()) {
+          throw std::runtime_error("Failed to load controls from JSON. ctrl is not an object.");
+      }
+
+      try{
+          // get the ctrl type
+          juce::String ctrl_type = ctrl["ctrl_type"].toString().toStdString();
+
+          // create the ctrl
+          if (ctrl_type == "slider") {
+            auto slider = std::make_shared<SliderCtrl>();
+            slider->id = juce::Uuid();
+            slider->label = ctrl["label"].toString().toStdString();
+            slider->minimum = ctrl["minimum"].toString().getFloatValue();
+            slider->maximum = ctrl["maximum"].toString().getFloatValue();
+            slider->step = ctrl["step"].toString().getFloatValue();
+            slider->value = ctrl["value"].toString().getFloatValue();
+
+            ctrls.push_back({slider->id, slider});
+            LogAndDBG("Slider: " + slider->label + " added");
+          }
+          else if (ctrl_type == "text") {
+            auto text = std::make_shared<TextBoxCtrl>();
+            text->id = juce::Uuid();
+            text->label = ctrl["label"].toString().toStdString();
+            text->value = ctrl["value"].toString().toStdString();
+
+            ctrls.push_back({text->id, text});
+            LogAndDBG("Text: " + text->label + " added");
+          }
+          else if (ctrl_type == "audio_in") {
+            auto audio_in = std::make_shared<AudioInCtrl>();
+            audio_in->id = juce::Uuid();
+            audio_in->label = ctrl["label"].toString().toStdString();
+
+            ctrls.push_back({audio_in->id, audio_in});
+            LogAndDBG("Audio In: " + audio_in->label + " added");
+          }
+          else if (ctrl_type == "number_box") {
+            auto number_box = std::make_shared<NumberBoxCtrl>();
+            number_box->id = juce::Uuid();
+            number_box->label = ctrl["label"].toString().toStdString();
+            number_box->min = ctrl["min"].toString().getFloatValue();
+            number_box->max = ctrl["max"].toString().getFloatValue();
+            number_box->value = ctrl["value"].toString().getFloatValue();
+
+            ctrls.push_back({number_box->id, number_box});
+            LogAndDBG("Number Box: " + number_box->label + " added");
+          }
+          else if (ctrl_type == "toggle") {
+            auto toggle = std::make_shared<ToggleCtrl>();
+            toggle->id = juce::Uuid();
+            toggle->label = ctrl["label"].toString().toStdString();
+            toggle->value = (bool) ctrl["value"];
+
+            ctrls.push_back({toggle->id, toggle});
+            LogAndDBG("Toggle: " + toggle->label + " added");
+          }
+          else if (ctrl_type == "dropdown") {
+            auto dropdown = std::make_shared<ComboBoxCtrl>();
+            dropdown->id = juce::Uuid();
+            dropdown->label = ctrl["label"].toString().toStdString();
+            // gradio calls them choices, older specs called them options
+            auto* options = ctrl["choices"].getArray() != nullptr ? ctrl["choices"].getArray() : ctrl["options"].getArray();
+            if (options != nullptr) {
+              for (const auto& option : *options) {
+                dropdown->options.push_back(option.toString().toStdString());
+              }
+            }
+            dropdown->value = ctrl["value"].toString().toStdString();
+
+            ctrls.push_back({dropdown->id, dropdown});
+            LogAndDBG("Dropdown: " + dropdown->label + " added");
+          }
+          else {
+            LogAndDBG("failed to parse control with unknown type: " + ctrl_type);
+          }
+        }
+        catch (const char* e) {
+          throw std::runtime_error("Failed to load controls from JSON. " + std::string(e));
+        }
+      }
+
+    m_ctrls.set(std::move(ctrls));
+  }
+
+  // the channel count to send a file with numChannels in: the same if the
+  // card allows it, otherwise the closest the model takes
+  int channelsToSend(int numChannels) const {
+    const auto& accepted = m_card.channels;
+    if (accepted.empty() || std::find(accepted.begin(), accepted.end(), numChannels) != accepted.end()) {
+      return numChannels;
+    }
+    // prefer dropping channels over making some up
+    int best = 0;
+    for (int count : accepted) {
+      if (count <= numChannels && count > best) {
+        best = count;
+      }
+    }
+    return best > 0 ? best : *std::min_element(accepted.begin(), accepted.end());
+  }
+
+  // whether a multichannel file should go to a mono model one channel at a time
+  bool shouldSplitChannels(const juce::File& file) const {
+    return m_card.channels == std::vector<int> {1}
+           && audioutils::numChannels(file) > 1
+           && HARPSettings::getBool(settingkeys::splitChannels);
+  }
+
+  /**
+   * @brief Copies source to dest in the layout the model takes. Files it takes as they
+   * are are copied byte for byte, anything else is downmixed (or remapped) first,
+   * so a model that sums to mono doesn't get sent the channels it throws away.
+   */
+  bool writeForModel(const juce::File& source, const juce::File& dest) const {
+    const int numChannels = audioutils::numChannels(source);
+    const int target = channelsToSend(numChannels);
+    if (numChannels <= 0 || target == numChannels) {
+      return source.copyFileTo(dest);
+    }
+
+    juce::AudioBuffer<float> audio;
+    double sampleRate = 0;
+    if (!audioutils::readFile(source, audio, sampleRate)) {
+      return false;
+    }
+    if (target == 1) {
+      audio = audioutils::downmix(audio);
+    } else {
+      audioutils::conform(audio, sampleRate, sampleRate, target);
+    }
+    LogAndDBG("Sending " + juce::String(target) + " of " + juce::String(numChannels) + " channels");
+    return audioutils::writeWav(dest, audio, sampleRate);
+  }
+
+  /**
+   * @brief Processes every channel of file as a mono job of its own, all at the same
+   * time, and interleaves the results back into file.
+   * @param processOne processes one channel's file. every channel is handed flags.cancel
+   * (with a status file of its own), so it has to leave the cancel flag in place for the
+   * other channels; the caller clears it once this returns.
+   * @return false if the job was cancelled, in which case file is left untouched.
+   * will throw a std::runtime_error if any channel fails.
+   */
+  bool processChannels(const juce::File& file, const JobFlags& flags,
+                       const std::function<bool(const juce::File&, const JobFlags&)>& processOne) const {
+    juce::AudioBuffer<float> audio;
+    double sampleRate = 0;
+    if (!audioutils::readFile(file, audio, sampleRate)) {
+      throw std::runtime_error("Failed to read " + file.getFullPathName().toStdString());
+    }
+    const int numChannels = audio.getNumChannels();
+    LogAndDBG("Processing " + juce::String(numChannels) + " channels as separate jobs");
+
+    struct ChannelJob {
+      juce::File file;
+      JobFlags flags;
+      bool processed = false;
+      std::string error;
+    };
+    std::vector<ChannelJob> jobs((size_t) numChannels);
+    for (int ch = 0; ch < numChannels; ++ch) {
+      auto& job = jobs[(size_t) ch];
+      job.file = file.getSiblingFile(".harp_channel_" + juce::String(ch) + "_" + juce::Uuid().toString() + ".wav");
+      // one cancel flag stops every channel, each helper watches it itself
+      job.flags = {flags.cancel, JobFlags::makeUnique().status};
+      juce::AudioBuffer<float> channel(1, audio.getNumSamples());
+      channel.copyFrom(0, 0, audio, ch, 0, audio.getNumSamples());
+      if (!audioutils::writeWav(job.file, channel, sampleRate)) {
+        for (auto& written : jobs) {
+          written.file.deleteFile();
+        }
+        throw std::runtime_error("Failed to write channel " + std::to_string(ch + 1) + " for processing.");
+      }
+    }
+
+    flags.status.replaceWithText("Status.PROCESSING");
+    {
+      // the helpers do the waiting, so a thread per channel is all it takes.
+      // this thread takes the first channel itself.
+      auto runJob = [&processOne] (ChannelJob& job) {
+        try {
+          job.processed = processOne(job.file, job.flags);
+        } catch (const std::runtime_error& e) {
+          job.error = e.what();
+        }
+      };
+      std::vector<std::thread> threads;
+      for (size_t ch = 1; ch < jobs.size(); ++ch) {
+        threads.emplace_back(runJob, std::ref(jobs[ch]));
+      }
+      runJob(jobs.front());
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    }
+
+    std::string error;
+    bool processed = true;
+    juce::AudioBuffer<float> result;
+    double resultSampleRate = 0;
+    for (int ch = 0; ch < numChannels; ++ch) {
+      auto& job = jobs[(size_t) ch];
+      job.flags.status.deleteFile();
+      if (!job.error.empty() && error.empty()) {
+        error = "Channel " + std::to_string(ch + 1) + ": " + job.error;
+      }
+      processed = processed && job.processed;
+
+      juce::AudioBuffer<float> channel;
+      double channelSampleRate = 0;
+      if (error.empty() && processed && audioutils::readFile(job.file, channel, channelSampleRate)) {
+        if (ch == 0) {
+          resultSampleRate = channelSampleRate;
+          result.setSize(numChannels, channel.getNumSamples());
+          result.clear();
+        }
+        audioutils::conform(channel, channelSampleRate, resultSampleRate, 1);
+        result.copyFrom(ch, 0, channel, 0, 0, juce::jmin(channel.getNumSamples(), result.getNumSamples()));
+      } else if (error.empty() && processed) {
+        error = "Failed to read the processed channel " + std::to_string(ch + 1);
+      }
+      job.file.deleteFile();
+    }
+
+    if (!error.empty()) {
+      flags.status.replaceWithText("Status.ERROR");
+      throw std::runtime_error(error);
+    }
+    if (!processed) {
+      flags.status.replaceWithText("Status.CANCELED");
+      return false;
+    }
+
+    juce::TemporaryFile temp(file);
+    if (!audioutils::writeWav(temp.getFile(), result, resultSampleRate) || !temp.overwriteTargetFileWithTemporary()) {
+      throw std::runtime_error("Failed to write the processed channels to " + file.getFullPathName().toStdString());
+    }
+    flags.status.replaceWithText("Status.FINISHED");
+    return true;
+  }
+
+  juce::var loadJsonFromFile(const juce::File& file) const {
+    juce::var result;
+
+    LogAndDBG("Loading JSON from file: " + file.getFullPathName());
+    if (!file.existsAsFile()) {
+        LogAndDBG("File does not exist: " + file.getFullPathName());
+        return result;
+    }
+
+    juce::String fileContent = file.loadFileAsString();
+
+    juce::Result parseResult = juce::JSON::parse(fileContent, result);
+
+    if (parseResult.failed()) {
+        LogAndDBG("Failed to parse JSON: " + parseResult.getErrorMessage());
+        return juce::var();  // Return an empty var
+    }
+
+    return result;
+  }
+
+  juce::FileLogger& logger() const {
+    std::call_once(m_loggerCreated, [this] {
+      m_logger.reset(juce::FileLogger::createDefaultAppLogger("HARP", "webmodel.log", "hello, harp!"));
+    });
+    return *m_logger;
+  }
+
+  // each instance gets its own flag files, since more than one model
+  // can be loaded at the same time (e.g. in a pipeline)
+  juce::String m_instance_id {juce::Uuid().toString()};
+  juce::File m_cancel_flag_file {
+    juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("webwave2wave_CANCEL_" + m_instance_id)
+  };
+  juce::File m_status_flag_file {
+    juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("webwave2wave_STATUS_" + m_instance_id)
+  };
+  CtrlStore m_ctrls;
+
+private:
+  // nothing touches the disk until something is logged
+  mutable std::unique_ptr<juce::FileLogger> m_logger {nullptr};
+  mutable std::once_flag m_loggerCreated;
+};
+
+
+// a timer that checks the status of the model and broadcasts a change if if there is one.
+// it only runs while a job or a load is in progress, since nothing else changes the status.
+class ModelStatusTimer : public juce::Timer,
+                         public juce::ChangeBroadcaster {
+public:
+  ModelStatusTimer(std::shared_ptr<Wave2Wave> model) : m_model(model) {
+  }
+
+  ~ModelStatusTimer() override {
+    stopWatching();
+  }
+
+  // whether anything that reports through the status is still running.
+  // once it says no, the timer reports the final status and stops.
+  std::function<bool()> isBusy;
+
+  // starts polling, if it isn't already
+  void watch() {
+    if (!isTimerRunning()) {
+      diagnostics::IdleMonitor::get().setActive("model status", true);
+      startTimer(100);  // 100 ms interval
+    }
+  }
+
+  // follow a different model instance (e.g. after loading a new one)
+  void setModel(std::shared_ptr<Wave2Wave> model) {
+    m_model = model;
+    m_last_status.clear();
+  }
+
+  void timerCallback() override {
+    diagnostics::IdleMonitor::get().wakeup("model status");
+
+    // get the status of the model
+    std::string status = m_model->getStatusMessage();
+
+    // if the status has changed, broadcast a change
+    if (status != m_last_status) {
+      m_last_status = status;
+      sendChangeMessage();
+    }
+
+    if (isBusy && !isBusy()) {
+      stopWatching();
+    }
+  }
+
+private:
+  void stopWatching() {
+    stopTimer();
+    diagnostics::IdleMonitor::get().setActive("model status", false);
+  }
+
+  std::shared_ptr<Wave2Wave> m_model;
+  std::string m_last_status;
+};
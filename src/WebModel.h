@@ -10,52 +10,19 @@
 #pragma once
 
 #include <fstream>
+#include <mutex>
 
 
-#include "Model.h"
+#include "Wave2Wave.h"
+#include "Settings.h"
+#include "HelperProcess.h"
+#include "DeadlineScheduler.h"
+#include "AdaptiveLimiter.h"
 
 #include "juce_core/juce_core.h"
 // #include "juce_data_structres/juce_data_structures.h"
 
 
-struct Ctrl {
-  juce::Uuid id {""};
-  std::string label {""};
-  virtual ~Ctrl() = default; // virtual destructor
-};
-
-struct SliderCtrl : public Ctrl {
-  double minimum;
-  double maximum;
-  double step;
-  double value;
-};
-
-struct TextBoxCtrl : public Ctrl {
-  std::string value;
-};
-
-struct AudioInCtrl : public Ctrl {
-  std::string value;
-};
-
-
-struct NumberBoxCtrl : public Ctrl {
-  double min;
-  double max;
-  double value;
-};
-
-struct ToggleCtrl : public Ctrl {
-  bool value;
-};
-
-struct ComboBoxCtrl : public Ctrl {
-  std::vector<std::string> options;
-  std::string value;
-};
-
-
 juce::String resolveSpaceUrl(juce::String urlOrName) {
   if (urlOrName.contains("localhost") || urlOrName.contains("huggingface.co") || urlOrName.contains("http")) {
     // do nothing! the url is already valid
@@ -67,50 +34,76 @@ juce::String resolveSpaceUrl(juce::String urlOrName) {
   return urlOrName;
 }
 
-using CtrlList = std::vector<std::pair<juce::Uuid, std::shared_ptr<Ctrl>>>;
-
-namespace{
-
-
-}
-
-class WebWave2Wave : public Model {
+class WebWave2Wave : public Wave2Wave {
 public:
+  using Wave2Wave::process;
+
+  struct HelperRun : HelperProcess::Result {
+    // the stage that ran out of time, if any
+    juce::String timedOutStage;
+    // how long the job waited in the space's queue
+    double queueSeconds {0};
+    // the space turned away at least one request for coming too often (the helper retried it)
+    bool rateLimited {false};
+    // the helper gave up on an error of the space or the network, rather than of the job itself
+    bool transientFailure {false};
+  };
 
-  void LogAndDBG(const juce::String& message) const {
-    DBG(message);
-
-    if (m_logger) {
-      m_logger->logMessage(message);
-    }
-  }
-
-  std::pair<juce::String, juce::uint32> run_command(std::string command) const {
-    juce::ChildProcess process;
-    bool status;
-
-    status = process.start(command);
-
-    if (!status) {
-      LogAndDBG("Process failed!");
+  /**
+   * @brief Runs the helper. The helper is killed if it doesn't stop soon after cancelFlag shows up.
+   * Every stage the helper reports (connect, upload, queue, inference, download) gets its own
+   * time limit from the settings. Running out of time cancels the job through cancelFlag.
+   * The output goes straight to the log, line by line, and progress lines update getStatusMessage().
+   */
+  HelperRun run_command(std::string command, const juce::File& cancelFlag) const {
+    StageDeadlines deadlines(*m_deadlines, [this, cancelFlag] (const juce::String& stage) {
+      LogAndDBG("HARP.Deadline: " + stage + " took too long, cancelling");
+      cancelFlag.create();
+    });
+    // starting the helper counts as connecting, until it says otherwise
+    deadlines.enter("connect", stageTimeout("connect"));
+
+    setProgress({});
+    HelperRun result;
+    double queueEntered = -1;
+    static_cast<HelperProcess::Result&>(result) = HelperProcess::run(
+        command, cancelFlag, HARPSettings::getInt(settingkeys::cancelGraceMs),
+        [this, &deadlines, &result, &queueEntered] (const juce::String& line) {
+          LogAndDBG(line);
+          HelperProgress progress;
+          if (HelperProgress::parse(line, progress)) {
+            setProgress(progress);
+          } else if (line.startsWith("HARP.Stage ")) {
+            auto stage = line.fromFirstOccurrenceOf("HARP.Stage ", false, false).trim();
+            deadlines.enter(stage, stageTimeout(stage));
+            // the time spent queueing is what tells how busy the space is
+            const auto now = juce::Time::getMillisecondCounterHiRes();
+            if (stage == "queue") {
+              queueEntered = now;
+            } else if (queueEntered >= 0) {
+              result.queueSeconds += (now - queueEntered) / 1000.0;
+              queueEntered = -1;
+            }
+          } else if (line.startsWith("HARP.Retry ") && (line.contains("429") || line.contains("Too Many Requests"))) {
+            result.rateLimited = true;
+          } else if (line.startsWith("HARP.Transient")) {
+            result.transientFailure = true;
+          }
+        });
+    deadlines.stop();
+    setProgress({});
+    result.timedOutStage = deadlines.expiredStage();
+
+    if (result.cancelled()) {
+      LogAndDBG("HARP.Cancel: helper stopped " + juce::String(result.cancelLatencyMs, 0) + " ms after cancel"
+                + (result.killed ? " (killed after the grace period)" : ""));
     }
-
-    juce::String output = process.readAllProcessOutput();
-    juce::uint32 exit_code = process.getExitCode();
-
-    // LogAndDBG("Process output: " + output);
-    // LogAndDBG("Exit code: " + juce::String(exit_code));
-
-    return std::make_pair(output, exit_code);
+    return result;
   }
 
   WebWave2Wave() { // TODO: should be a singleton
-
-    // create our logger
-    m_logger.reset(juce::FileLogger::createDefaultAppLogger("HARP", "webmodel.log", "hello, harp!"));
-
-
-    m_status_flag_file.replaceWithText("Status.INITIALIZED");
+    // nothing here touches the disk: the logger and the flag files are only
+    // created once they are needed, so a fresh model costs next to nothing
 
     #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 
@@ -118,7 +111,8 @@ public:
         juce::File::currentApplicationFile
       ).getParentDirectory().getChildFile("Resources/gradiojuce_client/gradiojuce_client.exe");
 
-      std::system("start /B cmd /c set PYTHONIOENCODING=UTF-8");
+      // inherited by the helper. (spawning a shell to set it only set it for that shell)
+      _putenv_s("PYTHONIOENCODING", "UTF-8");
     #elif __APPLE__
       scriptPath = juce::File::getSpecialLocation(
           juce::File::currentApplicationFile
@@ -134,18 +128,38 @@ public:
     #endif
   }
 
-  ~WebWave2Wave() {
-    // clean up flag files
-    m_cancel_flag_file.deleteFile();
-    m_status_flag_file.deleteFile();
+  ~WebWave2Wave() override {
+    cancelPreupload();
   }
 
+  std::string space_url() const override { return m_url; }
+
+  /**
+   * @brief Starts uploading file to the space in the background, so a job for the same
+   * audio can use the copy that is already there (see uploadCacheSeconds). An upload
+   * that is still running for another file is cancelled first.
+   */
+  void preupload(const juce::File& file) {
+    cancelPreupload();
+    if (!m_loaded || HARPSettings::getDouble(settingkeys::uploadCacheSeconds) <= 0) {
+      return;
+    }
+    auto upload = std::make_shared<PreuploadThread>(*this, file);
+    upload->startThread();
+    std::lock_guard<std::mutex> lock(m_preuploadMutex);
+    m_preupload = upload;
+  }
 
-  bool ready() const override { return m_loaded; }
-  std::string space_url() const { return m_url; }
-
-  juce::File getLogFile() const {
-    return m_logger->getLogFile();
+  void cancelPreupload() {
+    std::shared_ptr<PreuploadThread> upload;
+    {
+      std::lock_guard<std::mutex> lock(m_preuploadMutex);
+      upload.swap(m_preupload);
+    }
+    if (upload != nullptr) {
+      upload->flags.cancel.create();
+      upload->stopThread(HARPSettings::getInt(settingkeys::cancelGraceMs) + 1000);
+    }
   }
 
   void load(const map<string, any> &params) override {
@@ -161,10 +175,18 @@ public:
     m_url = url; // Store the URL for future use
     LogAndDBG("url: " + m_url);
 
-    juce::File outputPath = juce::File::getSpecialLocation(juce::File::tempDirectory)
-            .getChildFile("control_spec.json");
-    outputPath.deleteFile();
+    if (juce::String(m_url).trim().endsWithIgnoreCase(".onnx")) {
+        throw std::runtime_error(m_url + " is an onnx model, but this build of HARP can't run those. "
+                                 "Build it with -DHARP_WITH_ONNXRUNTIME=ON.");
+    }
+
+    // a file of its own for every load, models load at the same time from the UI and the control server.
+    // it goes away with this scope, whichever way the load ends.
+    juce::TemporaryFile specFile(".json");
+    const juce::File outputPath = specFile.getFile();
 
+    // loading can't be cancelled from the UI, but it can run out of time
+    auto loadFlags = JobFlags::makeUnique();
 
     std::string command = (
       prefix_cmd
@@ -172,17 +194,26 @@ public:
       + " --mode get_ctrls"
       + " --url " + m_url
       + " --output_path " + outputPath.getFullPathName().toStdString()
+      // loading a model is when a change to the space should show up. the
+      // config fetched here is cached, and every process() after it reuses it.
+      + " --refresh_config"
+      + " --cancel_flag_path " + loadFlags.cancel.getFullPathName().toStdString()
+      + retryArgs()
       // + " >> " + tempLogFile.getFullPathName().toStdString()   // redirect stdout to the temp log file
       // + " 2>&1"   // redirect stderr to the same file as stdout
     );
 
 
     LogAndDBG("Running command: " + command);
-    std::pair<juce::String, juce::uint32> cmd_result = run_command(command);
+    auto cmd_result = run_command(command, loadFlags.cancel);
+    loadFlags.cleanup();
 
-    juce::String logContent = cmd_result.first;
-    juce::uint32 result = cmd_result.second;
-    LogAndDBG(logContent);
+    juce::String logContent = cmd_result.output;
+    juce::uint32 result = cmd_result.exitCode;
+
+    if (cmd_result.timedOutStage.isNotEmpty()) {
+        throw std::runtime_error(timeoutMessage(cmd_result.timedOutStage));
+    }
 
     if (result != 0) {
         // read the text from the temp log file.
@@ -199,7 +230,7 @@ public:
             message = "The web request to " + m_url + " returned a 404 error. The space does not exist."; 
         }
         else if (logContent.contains("httpx.ReadTimeout")) {
-            message = "The web request to " + m_url + " timed out. The model is probably 'sleeping'. Make sure the gradio server is running and try again!";
+            message = "The web request to " + m_url + " timed out, even after retrying. The model is probably 'sleeping'. Make sure the gradio server is running and try again!";
         }
         // try to catch a generic Error:
         else if (logContent.contains("Error:")) {
@@ -221,7 +252,7 @@ public:
             message = "An error occurred while calling the gradiojuce helper with mode get_ctrls. ";
         }
 
-        message += "\n Check the logs " + m_logger->getLogFile().getFullPathName().toStdString() + " for more details.";
+        message += "\n Check the logs " + logger().getLogFile().getFullPathName().toStdString() + " for more details.";
         throw std::runtime_error(message);
 
     }
@@ -233,125 +264,14 @@ public:
         throw std::runtime_error("Failed to load controls from JSON. juce::var was void.");
     }
 
-    juce::DynamicObject *ctrlDict = controls.getDynamicObject();
-    if (ctrlDict == nullptr) {
-        throw std::runtime_error("Failed to load control dict from JSON. ctrlDict is null.");
-    }
-
-    // the "ctrls" key should be a list of dicts
-    // the "card" key should be the modelcard
-
-    // BEGIN  MODELCARD
-    if (!ctrlDict->hasProperty("card")) {
-        throw std::runtime_error("Failed to load model card from JSON. card key not found.");
-    }
-    juce::DynamicObject *jsonCard = ctrlDict->getProperty("card").getDynamicObject();
-    if (jsonCard == nullptr) {
-        throw std::runtime_error("Failed to load model card from JSON.");
-    }
-
-    // TODO: probably need to check if these properties exist and if they're the right types.
-    m_card = ModelCard();
-    m_card.name = jsonCard->getProperty("name").toString().toStdString();
-    m_card.description = jsonCard->getProperty("description").toString().toStdString();
-    m_card.author = jsonCard->getProperty("author").toString().toStdString();
-
-    // tags is a list of str
-    juce::Array<juce::var> *tags = jsonCard->getProperty("tags").getArray();
-    if (tags == nullptr) {
-        throw std::runtime_error("Failed to load tags from JSON. tags is null.");
-    }
-    for (int i = 0; i < tags->size(); i++) {
-      m_card.tags.push_back(tags->getReference(i).toString().toStdString());
-    }
-    // END MODELCARD
-
-    if (!ctrlDict->hasProperty("ctrls")) {
-        throw std::runtime_error("Failed to load controls from JSON. ctrls key not found.");
-    }
-    // else, it should be a list of dicts
-    juce::Array<juce::var> *ctrlList = ctrlDict->getProperty("ctrls").getArray();
-    if (ctrlList == nullptr) {
-        throw std::runtime_error("Failed to load controls from JSON. ctrlList is null.");
-    }
-
-    // clear the m_ctrls vector
-    m_ctrls.clear();
-
-    // iterate through the list of controls
-    // and add them to the m_ctrls vector
-    for (int i = 0; i < ctrlList->size(); i++) {
-      juce::var ctrl = ctrlList->getReference(i);
-      if (!ctrl.isObject()) {
-          throw std::runtime_error("Failed to load controls from JSON. ctrl is not an object.");
-      }
-
-      try{
-          // get the ctrl type
-          juce::String ctrl_type = ctrl["ctrl_type"].toString().toStdString();
-
-          // create the ctrl
-          if (ctrl_type == "slider") {
-            auto slider = std::make_shared<SliderCtrl>();
-            slider->id = juce::Uuid();
-            slider->label = ctrl["label"].toString().toStdString();
-            slider->minimum = ctrl["minimum"].toString().getFloatValue();
-            slider->maximum = ctrl["maximum"].toString().getFloatValue();
-            slider->step = ctrl["step"].toString().getFloatValue();
-            slider->value = ctrl["value"].toString().getFloatValue();
-
-            m_ctrls.push_back({slider->id, slider});
-            LogAndDBG("Slider: " + slider->label + " added");
-          }
-          else if (ctrl_type == "text") {
-            auto text = std::make_shared<TextBoxCtrl>();
-            text->id = juce::Uuid();
-            text->label = ctrl["label"].toString().toStdString();
-            text->value = ctrl["value"].toString().toStdString();
-
-            m_ctrls.push_back({text->id, text});
-            LogAndDBG("Text: " + text->label + " added");
-          }
-          else if (ctrl_type == "audio_in") {
-            auto audio_in = std::make_shared<AudioInCtrl>();
-            audio_in->label = ctrl["label"].toString().toStdString();
-
-            m_ctrls.push_back({audio_in->id, audio_in});
-            LogAndDBG("Audio In: " + audio_in->label + " added");
-          }
-          else if (ctrl_type == "number_box") {
-            auto number_box = std::make_shared<NumberBoxCtrl>();
-            number_box->label = ctrl["label"].toString().toStdString();
-            number_box->min = ctrl["min"].toString().getFloatValue();
-            number_box->max = ctrl["max"].toString().getFloatValue();
-            number_box->value = ctrl["value"].toString().getFloatValue();
-
-            m_ctrls.push_back({number_box->id, number_box});
-            LogAndDBG("Number Box: " + number_box->label + " added");
-          }
-          else {
-            LogAndDBG("failed to parse control with unknown type: " + ctrl_type);
-          }
-        }
-        catch (const char* e) {
-          throw std::runtime_error("Failed to load controls from JSON. " + std::string(e));
-        }
-      }
-
-    outputPath.deleteFile();
+    loadSpec(controls);
     m_loaded = true;
 
     // set the status to LOADED
     m_status_flag_file.replaceWithText("Status.LOADED");
   }
 
-  CtrlList& controls() {
-    return m_ctrls;
-  }
-
-  void process(juce::File filetoProcess) const {
-    // clear the cancel flag file
-    m_cancel_flag_file.deleteFile();
+  bool process(juce::File filetoProcess, const CtrlList& ctrls, const JobFlags& flags) const override {
 
     // make sure we're loaded
     LogAndDBG("WebWave2Wave::process");
@@ -359,6 +279,43 @@ public:
       throw std::runtime_error("Model not loaded");
     }
 
+    // an upload of this file may be under way already, going along with it
+    // is quicker than sending the file a second time
+    waitForPreupload(flags);
+
+    bool processed = false;
+    try {
+      // a mono model can get one job per channel instead of a downmix. every channel's
+      // helper watches the same cancel flag, so it is only cleared once all of them are done.
+      if (shouldSplitChannels(filetoProcess)) {
+        processed = processChannels(filetoProcess, flags,
+                                    [this, &ctrls] (const juce::File& channel, const JobFlags& channelFlags) {
+                                      return processFile(channel, ctrls, channelFlags);
+                                    });
+      } else {
+        processed = processFile(filetoProcess, ctrls, flags);
+      }
+    } catch (...) {
+      flags.cancel.deleteFile();
+      throw;
+    }
+
+    // clear the cancel flag file
+    flags.cancel.deleteFile();
+    return processed;
+  }
+
+  // the status, along with what the helper last said about the progress of the job
+  std::string getStatusMessage() override {
+    auto status = getStatus();
+    std::lock_guard<std::mutex> lock(m_progressMutex);
+    auto progress = m_progress.describe();
+    return progress.isEmpty() ? status : status + " (" + progress.toStdString() + ")";
+  }
+
+private:
+  // runs one file through the helper. leaves the cancel flag alone, process() clears it
+  bool processFile(const juce::File& filetoProcess, const CtrlList& ctrls, const JobFlags& flags) const {
     // a random string to append to the input/output.wav files
     // This is necessary because more than 1 playback regions
     // are processed at the same time.
@@ -370,23 +327,40 @@ public:
         juce::File::getSpecialLocation(juce::File::tempDirectory)
             .getChildFile("input_" + randomString + ".wav");
     tempFile.deleteFile();
-    // copy the file to a temp file
-    filetoProcess.copyFileTo(tempFile);
 
-    // a tarrget output file
+    // the temp files go away however this returns, including when it throws
+    struct TempFiles {
+      std::vector<juce::File> files;
+      ~TempFiles() {
+        for (const auto& file : files) {
+          file.deleteFile();
+        }
+      }
+    } temps;
+    temps.files.push_back(tempFile);
+
+    // copy the file to a temp file, with only the channels the model takes
+    if (!writeForModel(filetoProcess, tempFile)) {
+      throw std::runtime_error("Failed to prepare " + filetoProcess.getFullPathName().toStdString() + " for upload.");
+    }
+
+    // a target output file, next to the file it replaces so the helper can
+    // write the result straight onto the destination filesystem and the move
+    // below is a rename instead of another copy
     juce::File tempOutputFile =
-        juce::File::getSpecialLocation(juce::File::tempDirectory)
-            .getChildFile("output_" + randomString + ".wav");
+        filetoProcess.getSiblingFile(".harp_output_" + randomString + ".wav");
     tempOutputFile.deleteFile();
+    temps.files.push_back(tempOutputFile);
 
     // a ctrls file
     juce::File tempCtrlsFile =
         juce::File::getSpecialLocation(juce::File::tempDirectory)
             .getChildFile("ctrls_" + randomString + ".json");
     tempCtrlsFile.deleteFile();
+    temps.files.push_back(tempCtrlsFile);
 
     LogAndDBG("saving controls...");
-    if (!saveCtrls(tempCtrlsFile, tempFile.getFullPathName().toStdString())) {
+    if (!saveCtrls(ctrls, tempCtrlsFile, tempFile.getFullPathName().toStdString())) {
       throw std::runtime_error("Failed to save controls to file.");
     }
 
@@ -398,17 +372,44 @@ public:
         + " --url " + m_url
         + " --output_path " + tempOutputFile.getFullPathName().toStdString()
         + " --ctrls_path " + tempCtrlsFile.getFullPathName().toStdString()
-        + " --cancel_flag_path " + m_cancel_flag_file.getFullPathName().toStdString()
-        + " --status_flag_path " + m_status_flag_file.getFullPathName().toStdString()
+        + " --cancel_flag_path " + flags.cancel.getFullPathName().toStdString()
+        + " --status_flag_path " + flags.status.getFullPathName().toStdString()
+        + retryArgs()
+        + hedgeArgs()
+        + " --upload_ttl " + juce::String(HARPSettings::getDouble(settingkeys::uploadCacheSeconds)).toStdString()
         // + " >> " + tempLogFile.getFullPathName().toStdString()   // redirect stdout to the temp log file
         // + " 2>&1"   // redirect stderr to the same file as stdout
     );
+    // how many jobs run against this space at once adapts to how it copes
+    auto& limiter = AdaptiveLimiter::forUrl(m_url);
+    auto slot = limiter.acquire(flags.cancel);
+    if (slot == nullptr) {
+        flags.status.replaceWithText("Status.CANCELED");
+        return false;
+    }
+
     LogAndDBG("Running command: " + command);
-    std::pair<juce::String, int> cmd_result = run_command(command);
+    auto cmd_result = run_command(command, flags.cancel);
+    slot->finish(limiterOutcome(cmd_result), cmd_result.queueSeconds);
+    LogAndDBG("HARP.Limiter " + juce::String(limiter.getLimit(), 2) + " jobs at once for " + m_url);
+
+    juce::String logContent = cmd_result.output;
+    juce::uint32 result = cmd_result.exitCode;
+
+    // a job that ran out of time was cancelled, but it's still an error
+    if (cmd_result.timedOutStage.isNotEmpty()) {
+        flags.status.replaceWithText("Status.TIMED_OUT");
+        removePartialDownloads(tempOutputFile);
+        throw std::runtime_error(timeoutMessage(cmd_result.timedOutStage));
+    }
 
-    juce::String logContent = cmd_result.first;
-    juce::uint32 result = cmd_result.second;
-    LogAndDBG(logContent);
+    // a helper that had to be killed left no output behind, the job is just cancelled
+    if (cmd_result.killed) {
+        flags.status.replaceWithText(cancelledStatus(cmd_result));
+        // (but it may have been halfway through downloading it)
+        removePartialDownloads(tempOutputFile);
+        return false;
+    }
 
     if (result != 0) {
         // read the text from the temp log file.
@@ -430,112 +431,113 @@ public:
             message = "An error occurred while calling the gradiojuce helper with mode predict. ";
         }
 
-        message += "\n Check the logs " + m_logger->getLogFile().getFullPathName().toStdString() + " for more details.";
+        message += "\n Check the logs " + logger().getLogFile().getFullPathName().toStdString() + " for more details.";
+
+        throw std::runtime_error(message);
     }
 
     // move the temp output file to the original input file
-    tempOutputFile.moveFileTo(filetoProcess);
+    // (a canceled job has no output, and leaves the input untouched)
+    const bool hasOutput = tempOutputFile.existsAsFile();
+    if (!hasOutput && cmd_result.cancelled()) {
+        flags.status.replaceWithText(cancelledStatus(cmd_result));
+    }
+    if (hasOutput && !tempOutputFile.moveFileTo(filetoProcess)) {
+        throw std::runtime_error("Failed to move the output to " + filetoProcess.getFullPathName().toStdString());
+    }
 
-    // delete the temp input file
-    tempFile.deleteFile();
-    tempOutputFile.deleteFile();
-    tempCtrlsFile.deleteFile();
     LogAndDBG("WebWave2Wave::process done");
+    return hasOutput;
+  }
 
-    // clear the cancel flag file
-    m_cancel_flag_file.deleteFile();
-    return;
+  static double stageTimeout(const juce::String& stage) {
+    static const std::map<juce::String, const char*> keys {
+      {"connect", settingkeys::connectTimeout},
+      {"upload", settingkeys::uploadTimeout},
+      {"queue", settingkeys::queueTimeout},
+      {"inference", settingkeys::inferenceTimeout},
+      {"download", settingkeys::downloadTimeout},
+    };
+    auto key = keys.find(stage);
+    return key == keys.end() ? 0.0 : HARPSettings::getDouble(key->second);
   }
 
-  // sets a cancel flag file that the client can check to see if the process
-  // should be cancelled
-  void cancel() {
-    m_cancel_flag_file.deleteFile();
-    m_cancel_flag_file.create();
+  std::string timeoutMessage(const juce::String& stage) const {
+    static const std::map<juce::String, juce::String> doing {
+      {"connect", "connecting to"},
+      {"upload", "uploading the audio to"},
+      {"queue", "waiting in the queue of"},
+      {"inference", "waiting for the result from"},
+      {"download", "downloading the result from"},
+    };
+    auto it = doing.find(stage);
+    return ("Gave up " + (it == doing.end() ? "waiting for" : it->second) + " " + juce::String(m_url)
+            + " after " + juce::String(stageTimeout(stage), 0) + " s. Please check that the space is awake,"
+            + " or raise the time limit in the settings file.").toStdString();
   }
 
-  std::string getStatus() {
-    // if the status file doesn't exist, return Status.INACTIVE
-    if (!m_status_flag_file.exists()) {
-      return "Status.INACTIVE";
+  // the helper streams the result into a .part file next to the output, which is left behind if it is killed
+  static void removePartialDownloads(const juce::File& output) {
+    for (const auto& partial : output.getParentDirectory().findChildFiles(
+             juce::File::findFiles, false, output.getFileName() + ".*.part")) {
+      partial.deleteFile();
     }
-
-    // read the status file and return its text
-    juce::String status = m_status_flag_file.loadFileAsString();
-    return status.toStdString();
   }
 
-  juce::File getCancelFlagFile() const {
-    return m_cancel_flag_file;
+  void setProgress(const HelperProgress& progress) const {
+    std::lock_guard<std::mutex> lock(m_progressMutex);
+    m_progress = progress;
   }
 
-  CtrlList::iterator findCtrlByUuid(const juce::Uuid& uuid) {
-    return std::find_if(m_ctrls.begin(), m_ctrls.end(),
-        [&uuid](const CtrlList::value_type& pair) {
-            return pair.first == uuid;
-        }
-    );
+  // reports how long it took for the cancel to go through
+  static juce::String cancelledStatus(const HelperProcess::Result& result) {
+    return "Status.CANCELED (stopped in " + juce::String(result.cancelLatencyMs / 1000.0, 2) + " s)";
   }
 
-private:
-  juce::var loadJsonFromFile(const juce::File& file) const {
-    juce::var result;
-
-    LogAndDBG("Loading JSON from file: " + file.getFullPathName());
-    if (!file.existsAsFile()) {
-        LogAndDBG("File does not exist: " + file.getFullPathName());
-        return result;
+  // the helper retries transient network errors on its own, these tell it how
+  static AdaptiveLimiter::Outcome limiterOutcome(const HelperRun& run) {
+    if (run.timedOutStage.isNotEmpty()) {
+      return AdaptiveLimiter::Outcome::Failed;
     }
-
-    juce::String fileContent = file.loadFileAsString();
-
-    juce::Result parseResult = juce::JSON::parse(fileContent, result);
-
-    if (parseResult.failed()) {
-        LogAndDBG("Failed to parse JSON: " + parseResult.getErrorMessage());
-        return juce::var();  // Return an empty var
+    if (run.killed || run.cancelled()) {
+      return AdaptiveLimiter::Outcome::Cancelled;
     }
+    // a job that got through in the end counts, however many 429s it took
+    if (run.exitCode == 0) {
+      return AdaptiveLimiter::Outcome::Success;
+    }
+    if (run.rateLimited) {
+      return AdaptiveLimiter::Outcome::RateLimited;
+    }
+    // bad controls or a model that throws say nothing about how busy the space is
+    return run.transientFailure ? AdaptiveLimiter::Outcome::Failed : AdaptiveLimiter::Outcome::Cancelled;
+  }
 
-    return result;
+  std::string retryArgs() const {
+    return " --max_retries " + juce::String(HARPSettings::getInt(settingkeys::maxRetries)).toStdString()
+           + " --retry_base_delay " + juce::String(HARPSettings::getDouble(settingkeys::retryBaseDelay)).toStdString()
+           + " --retry_max_delay " + juce::String(HARPSettings::getDouble(settingkeys::retryMaxDelay)).toStdString();
   }
 
-  bool saveCtrls(juce::File savePath, std::string audioInputPath) const {
-    // Create a JSON array to hold each control's value
-    juce::Array<juce::var> jsonCtrlsArray;
-
-    // Iterate through each control in m_ctrls
-    for (const auto& ctrlPair : m_ctrls) {
-        auto ctrl = ctrlPair.second;
-
-        // Check the type of ctrl and extract its value
-        if (auto sliderCtrl = dynamic_cast<SliderCtrl*>(ctrl.get())) {
-            // Slider control, use sliderCtrl->value
-            jsonCtrlsArray.add(juce::var(sliderCtrl->value));
-        } else if (auto textBoxCtrl = dynamic_cast<TextBoxCtrl*>(ctrl.get())) {
-            // Text box control, use textBoxCtrl->value
-            jsonCtrlsArray.add(juce::var(textBoxCtrl->value));
-        } else if (auto numberBoxCtrl = dynamic_cast<NumberBoxCtrl*>(ctrl.get())) {
-            // Number box control, use numberBoxCtrl->value
-            jsonCtrlsArray.add(juce::var(numberBoxCtrl->value));
-        } else if (auto toggleCtrl = dynamic_cast<ToggleCtrl*>(ctrl.get())) {
-            // Toggle control, use toggleCtrl->value
-            jsonCtrlsArray.add(juce::var(toggleCtrl->value));
-        } else if (auto comboBoxCtrl = dynamic_cast<ComboBoxCtrl*>(ctrl.get())) {
-            // Combo box control, use comboBoxCtrl->value
-            jsonCtrlsArray.add(juce::var(comboBoxCtrl->value));
-        } else if (auto audioInCtrl = dynamic_cast<AudioInCtrl*>(ctrl.get())) {
-            // Audio in control, use audioInCtrl->value
-            audioInCtrl->value = audioInputPath;
-            jsonCtrlsArray.add(juce::var(audioInCtrl->value));
-        } else {
-            // Unsupported control type or missing implementation
-            LogAndDBG("Unsupported control type or missing implementation for control with ID: " + ctrl->id.toString());
-            return false;
-        }
+  // a duplicate request is only sent for predictions, never for get_ctrls
+  std::string hedgeArgs() const {
+    auto hedgeAfter = HARPSettings::getDouble(settingkeys::hedgeAfter);
+    if (hedgeAfter <= 0) {
+      return "";
+    }
+    std::string args = " --hedge_after " + juce::String(hedgeAfter).toStdString();
+    auto hedgeUrl = HARPSettings::getString(settingkeys::hedgeUrl);
+    if (hedgeUrl.isNotEmpty()) {
+      args += " --hedge_url " + resolveSpaceUrl(hedgeUrl).toStdString();
     }
+    return args;
+  }
 
-    // Convert the array to a JSON string
-    juce::String jsonText = juce::JSON::toString(jsonCtrlsArray, true);  // true for human-readable
+  bool saveCtrls(const CtrlList& ctrls, juce::File savePath, std::string audioInputPath) const {
+    juce::String jsonText = ctrlsToJson(ctrls, audioInputPath);
+    if (jsonText.isEmpty()) {
+        return false;
+    }
 
     // Write the JSON string to the specified file path
     if (!savePath.replaceWithText(jsonText)) {
@@ -546,40 +548,70 @@ private:
     return true;
   }
 
-  juce::File m_cancel_flag_file {
-    juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("webwave2wave_CANCEL")
-  };
-  juce::File m_status_flag_file {
-    juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("webwave2wave_STATUS")
-  };
-  CtrlList m_ctrls;
-  std::unique_ptr<juce::FileLogger> m_logger {nullptr};
+  // uploads a file the way process() would, without running the model
+  class PreuploadThread : public juce::Thread {
+  public:
+    PreuploadThread(const WebWave2Wave& model, juce::File file)
+        : juce::Thread("HARP pre-upload"), flags(JobFlags::makeUnique()), m_model(model), m_file(file) {}
 
-  string m_url;
-  string prefix_cmd;
-  juce::File scriptPath;
-};
+    ~PreuploadThread() override {
+      flags.cleanup();
+    }
 
+    void run() override {
+      auto input = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                       .getChildFile("preupload_" + juce::Uuid().toString() + ".wav");
+      // the same bytes process() would send, so the content hash matches
+      if (m_model.writeForModel(m_file, input)) {
+        m_model.LogAndDBG("Pre-uploading " + m_file.getFullPathName());
+        auto result = m_model.run_command(
+            m_model.prefix_cmd
+            + m_model.scriptPath.getFullPathName().toStdString()
+            + " --mode upload"
+            + " --url " + m_model.m_url
+            + " --input_path " + input.getFullPathName().toStdString()
+            + " --upload_ttl " + juce::String(HARPSettings::getDouble(settingkeys::uploadCacheSeconds)).toStdString()
+            + m_model.retryArgs(),
+            flags.cancel);
+        if (result.exitCode != 0 && !result.cancelled()) {
+          m_model.LogAndDBG("Pre-upload failed, the file will be sent with the job");
+        }
+      }
+      input.deleteFile();
+    }
 
-// a timer that checks the status of the model and broadcasts a change if if there is one
-class ModelStatusTimer : public juce::Timer,
-                         public juce::ChangeBroadcaster {
-public:
-  ModelStatusTimer(std::shared_ptr<WebWave2Wave> model) : m_model(model) {
-  }
+    JobFlags flags;
 
-  void timerCallback() override {
-    // get the status of the model
-    std::string status = m_model->getStatus();
+  private:
+    const WebWave2Wave& m_model;
+    juce::File m_file;
+  };
 
-    // if the status has changed, broadcast a change
-    if (status != m_last_status) {
-      m_last_status = status;
-      sendChangeMessage();
+  void waitForPreupload(const JobFlags& flags) const {
+    std::shared_ptr<PreuploadThread> upload;
+    {
+      std::lock_guard<std::mutex> lock(m_preuploadMutex);
+      upload = m_preupload;
+    }
+    while (upload != nullptr && upload->isThreadRunning()) {
+      if (flags.cancel.exists()) {
+        upload->flags.cancel.create();
+      }
+      upload->waitForThreadToExit(50);
     }
   }
 
-private:
-  std::shared_ptr<WebWave2Wave> m_model;
-  std::string m_last_status;
+  mutable std::mutex m_preuploadMutex;
+  // the last pre-upload, which may still be running
+  std::shared_ptr<PreuploadThread> m_preupload;
+
+  juce::SharedResourcePointer<DeadlineScheduler> m_deadlines;
+  // the latest progress line of the running job, if any
+  mutable std::mutex m_progressMutex;
+  mutable HelperProgress m_progress;
+
+  string m_url;
+  string prefix_cmd;
+  juce::File scriptPath;
 };
+
@@ -0,0 +1,127 @@
+#include "ResultsComponent.h"
+
+ResultsComponent::ResultsComponent()
+{
+    headingLabel.setFont(juce::Font(15.0f, juce::Font::bold));
+    addAndMakeVisible(headingLabel);
+
+    workingCopyButton.onClick = [this] {
+        if (onShowWorkingCopy) {
+            onShowWorkingCopy();
+        }
+    };
+    addAndMakeVisible(workingCopyButton);
+
+    exportButton.onClick = [this] {
+        if (onExport) {
+            onExport();
+        }
+    };
+    addAndMakeVisible(exportButton);
+
+    viewport.setViewedComponent(&rowHolder, false);
+    viewport.setScrollBarsShown(true, false);
+    addAndMakeVisible(viewport);
+
+    setSize(500, 300);
+}
+
+void ResultsComponent::setHeading(const juce::String& text)
+{
+    headingLabel.setText(text, juce::dontSendNotification);
+}
+
+void ResultsComponent::addResult(const juce::String& label, const juce::File& file)
+{
+    auto row = std::make_unique<Row>();
+    row->file = file;
+    row->label.setText(label, juce::dontSendNotification);
+    row->label.setTooltip(file.getFullPathName());
+
+    auto* rowPtr = row.get();
+    row->playButton.onClick = [this, rowPtr] {
+        if (onPlay) {
+            onPlay(rowPtr->file);
+        }
+    };
+    row->useButton.onClick = [this, rowPtr] {
+        if (onUse) {
+            onUse(rowPtr->file);
+        }
+    };
+
+    row->addAndMakeVisible(row->label);
+    row->addAndMakeVisible(row->playButton);
+    row->addAndMakeVisible(row->useButton);
+    rowHolder.addAndMakeVisible(*row);
+    rows.push_back(std::move(row));
+    layoutRows();
+}
+
+void ResultsComponent::clearResults()
+{
+    for (auto& row : rows) {
+        rowHolder.removeChildComponent(row.get());
+    }
+    rows.clear();
+    layoutRows();
+}
+
+int ResultsComponent::getNumResults() const
+{
+    return (int) rows.size();
+}
+
+std::vector<std::pair<juce::String, juce::File>> ResultsComponent::getResults() const
+{
+    std::vector<std::pair<juce::String, juce::File>> results;
+    for (const auto& row : rows) {
+        results.push_back({row->label.getText(), row->file});
+    }
+    return results;
+}
+
+void ResultsComponent::resized()
+{
+    auto area = getLocalBounds().reduced(10);
+    auto header = area.removeFromTop(30);
+    workingCopyButton.setBounds(header.removeFromRight(140).reduced(2));
+    exportButton.setBounds(header.removeFromRight(80).reduced(2));
+    headingLabel.setBounds(header);
+    area.removeFromTop(5);
+    viewport.setBounds(area);
+    layoutRows();
+}
+
+void ResultsComponent::layoutRows()
+{
+    auto width = viewport.getMaximumVisibleWidth();
+    rowHolder.setSize(width, (int) rows.size() * rowHeight);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        rows[i]->setBounds(0, (int) i * rowHeight, width, rowHeight);
+    }
+}
+
+void ResultsComponent::Row::resized()
+{
+    auto area = getLocalBounds().reduced(2);
+    useButton.setBounds(area.removeFromRight(60).reduced(2));
+    playButton.setBounds(area.removeFromRight(60).reduced(2));
+    label.setBounds(area);
+}
+
+ResultsWindow::ResultsWindow(const juce::String& name, ResultsComponent& results)
+    : DocumentWindow(name,
+                     juce::Desktop::getInstance().getDefaultLookAndFeel()
+                         .findColour(juce::ResizableWindow::backgroundColourId),
+                     DocumentWindow::closeButton)
+{
+    setUsingNativeTitleBar(true);
+    setContentNonOwned(&results, true);
+    setResizable(true, false);
+}
+
+void ResultsWindow::closeButtonPressed()
+{
+    setVisible(false);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "juce_gui_basics/juce_gui_basics.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+// A list of processing results (e.g. the same input run through several
+// models) that can be auditioned side by side.
+class ResultsComponent : public juce::Component {
+public:
+    ResultsComponent();
+
+    void setHeading(const juce::String& text);
+    void addResult(const juce::String& label, const juce::File& file);
+    void clearResults();
+    int getNumResults() const;
+    // the label and file of every result, in the order they were added
+    std::vector<std::pair<juce::String, juce::File>> getResults() const;
+
+    void resized() override;
+
+    std::function<void(const juce::File&)> onPlay;
+    std::function<void(const juce::File&)> onUse;
+    std::function<void()> onShowWorkingCopy;
+    std::function<void()> onExport;
+
+private:
+    struct Row : public juce::Component {
+        juce::File file;
+        juce::Label label;
+        juce::TextButton playButton {"Play"};
+        juce::TextButton useButton {"Use"};
+
+        void resized() override;
+    };
+
+    void layoutRows();
+
+    juce::Label headingLabel;
+    juce::TextButton workingCopyButton {"Show Working Copy"};
+    juce::TextButton exportButton {"Export..."};
+    juce::Viewport viewport;
+    juce::Component rowHolder;
+    std::vector<std::unique_ptr<Row>> rows;
+
+    static constexpr int rowHeight = 32;
+};
+
+// A separate window for the results, so they don't squeeze the main layout
+class ResultsWindow : public juce::DocumentWindow {
+public:
+    ResultsWindow(const juce::String& name, ResultsComponent& results);
+    void closeButtonPressed() override;
+};
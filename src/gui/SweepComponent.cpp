@@ -0,0 +1,119 @@
+#include "SweepComponent.h"
+
+SweepComponent::SweepComponent(const CtrlSnapshot& ctrls)
+{
+    hintLabel.setText("Type the values each control should take. Controls left empty keep their current value.",
+                      juce::dontSendNotification);
+    addAndMakeVisible(hintLabel);
+
+    for (const auto& pair : *ctrls) {
+        if (!sweep::isSweepable(*pair.second)) {
+            continue;
+        }
+        auto row = std::make_unique<Row>();
+        row->ctrl = pair.second;
+        row->label.setText(pair.second->label, juce::dontSendNotification);
+        row->spec.setTextToShowWhenEmpty(sweep::describeSyntax(*pair.second), juce::Colours::grey);
+        row->spec.onTextChange = [this, rowPtr = row.get()] {
+            parseRow(*rowPtr);
+            updateSummary();
+        };
+        row->addAndMakeVisible(row->label);
+        row->addAndMakeVisible(row->spec);
+        rowHolder.addAndMakeVisible(*row);
+        rows.push_back(std::move(row));
+    }
+
+    viewport.setViewedComponent(&rowHolder, false);
+    viewport.setScrollBarsShown(true, false);
+    addAndMakeVisible(viewport);
+
+    addAndMakeVisible(summaryLabel);
+
+    runButton.onClick = [this] {
+        try {
+            auto axes = parseAxes();
+            if (axes.empty()) {
+                summaryLabel.setText("Nothing to sweep yet", juce::dontSendNotification);
+                return;
+            }
+            if (onRun) {
+                onRun(std::move(axes));
+            }
+        } catch (const std::runtime_error& e) {
+            summaryLabel.setText(e.what(), juce::dontSendNotification);
+        }
+    };
+    addAndMakeVisible(runButton);
+
+    updateSummary();
+    setSize(500, 120 + juce::jmin(8, (int) rows.size()) * rowHeight);
+}
+
+void SweepComponent::parseRow(Row& row)
+{
+    try {
+        row.values = sweep::parseValues(*row.ctrl, row.spec.getText());
+        row.error = {};
+    } catch (const std::runtime_error& e) {
+        row.values.clear();
+        row.error = e.what();
+    }
+}
+
+std::vector<SweepAxis> SweepComponent::parseAxes() const
+{
+    std::vector<SweepAxis> axes;
+    for (const auto& row : rows) {
+        if (row->error.isNotEmpty()) {
+            throw std::runtime_error(row->error.toStdString());
+        }
+        if (!row->values.isEmpty()) {
+            axes.push_back({row->ctrl->id, row->ctrl->label, row->values});
+        }
+    }
+    if (sweep::gridSize(axes) > sweep::maxGridSize) {
+        throw std::runtime_error("More than " + std::to_string(sweep::maxGridSize)
+                                 + " combinations, sweep fewer values at once");
+    }
+    return axes;
+}
+
+void SweepComponent::updateSummary()
+{
+    try {
+        auto size = sweep::gridSize(parseAxes());
+        summaryLabel.setText(size == 0 ? juce::String("Nothing to sweep yet")
+                                       : juce::String((int) size) + " combinations",
+                             juce::dontSendNotification);
+        runButton.setEnabled(size > 0);
+    } catch (const std::runtime_error& e) {
+        summaryLabel.setText(e.what(), juce::dontSendNotification);
+        runButton.setEnabled(false);
+    }
+}
+
+void SweepComponent::resized()
+{
+    auto area = getLocalBounds().reduced(10);
+    hintLabel.setBounds(area.removeFromTop(30));
+
+    auto footer = area.removeFromBottom(30);
+    runButton.setBounds(footer.removeFromRight(120).reduced(2));
+    summaryLabel.setBounds(footer);
+    area.removeFromBottom(5);
+    viewport.setBounds(area);
+
+    auto width = viewport.getMaximumVisibleWidth();
+    rowHolder.setSize(width, (int) rows.size() * rowHeight);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        rows[i]->setBounds(0, (int) i * rowHeight, width, rowHeight);
+    }
+}
+
+void SweepComponent::Row::resized()
+{
+    auto area = getLocalBounds().reduced(2);
+    label.setBounds(area.removeFromLeft(area.getWidth() / 3));
+    spec.setBounds(area);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "juce_gui_basics/juce_gui_basics.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "../Sweep.h"
+
+// Lets the user type the values each control should take in a parameter
+// sweep, and shows how many combinations that makes.
+class SweepComponent : public juce::Component {
+public:
+    explicit SweepComponent(const CtrlSnapshot& ctrls);
+
+    void resized() override;
+
+    // called with the parsed axes when Run is clicked
+    std::function<void(std::vector<SweepAxis>)> onRun;
+
+private:
+    struct Row : public juce::Component {
+        std::shared_ptr<const Ctrl> ctrl;
+        juce::Label label;
+        juce::TextEditor spec;
+        // what spec parsed to the last time it changed, or why it didn't parse
+        juce::Array<juce::var> values;
+        juce::String error;
+
+        void resized() override;
+    };
+
+    // parses the spec of row again, the other rows keep what they parsed to
+    void parseRow(Row& row);
+    // the axes of every row, throws a std::runtime_error for the first one that doesn't
+    // parse or if they make more than sweep::maxGridSize combinations
+    std::vector<SweepAxis> parseAxes() const;
+    void updateSummary();
+
+    juce::Label hintLabel;
+    juce::Viewport viewport;
+    juce::Component rowHolder;
+    std::vector<std::unique_ptr<Row>> rows;
+    juce::Label summaryLabel;
+    juce::TextButton runButton {"Run Sweep"};
+
+    static constexpr int rowHeight = 32;
+};